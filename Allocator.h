@@ -0,0 +1,389 @@
+#pragma once
+
+#include "Types.h"
+
+#include <assert.h>
+#include <stdlib.h> // malloc, realloc, free
+#include <string.h> // memcpy
+#include <stddef.h> // NULL
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/**
+
+   Allocators that containers can be handed instead of going to the global heap.
+
+   An Allocator is three function pointers, the same way Hash_Table takes its hash and comparator. Every
+   allocator struct starts with one so a pointer to it is the Allocator * that containers take. Containers given
+   NULL use heap_allocator.
+
+       heap_allocator   malloc, realloc and free.
+       Arena            bump allocator. Freeing is a no-op (except for the most recent allocation, which can also
+                        grow in place) and arena_reset releases everything at once. Give every container a request
+                        touches the request's arena and reset it when the request is done.
+       Pool_Allocator   fixed size blocks on a free list, for lots of same sized nodes. Bigger requests are passed
+                        on to the heap.
+       cache_line_allocator
+                        heap blocks aligned to ALLOCATOR_CACHE_LINE, for arrays that SIMD loops stream through.
+
+   Every allocation is aligned to ALLOCATOR_ALIGNMENT. Sizes are passed back on free and reallocate so allocators
+   don't need per allocation headers, containers always know how big their block is anyway.
+
+   page_allocate and friends go straight to the OS for huge blocks. Resizing them with mremap moves page table
+   entries instead of copying bytes, and pages that are never touched never become resident.
+
+   After an arena reset the containers that used it must not be touched again, not even to deinit them. Deinit
+   any whose elements have destructors that need to run before resetting.
+
+**/
+
+#define ALLOCATOR_ALIGNMENT 16
+
+#ifndef ARENA_DEFAULT_BLOCK_SIZE
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+#endif
+
+#define POOL_BLOCKS_PER_CHUNK 64
+
+#define ALLOCATOR_PAGE_SIZE 4096
+
+#define ALLOCATOR_CACHE_LINE 64
+
+struct Allocator {
+    void *(*allocate)(Allocator *allocator, u64 size);
+    void *(*reallocate)(Allocator *allocator, void *memory, u64 old_size, u64 new_size);
+    void  (*deallocate)(Allocator *allocator, void *memory, u64 size);
+};
+
+inline u64 align_forward(u64 value, u64 alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+//
+// Heap
+//
+inline void *heap_allocate(Allocator *, u64 size) {
+    return malloc(size);
+}
+
+inline void *heap_reallocate(Allocator *, void *memory, u64, u64 new_size) {
+    return realloc(memory, new_size);
+}
+
+inline void heap_deallocate(Allocator *, void *memory, u64) {
+    free(memory);
+}
+
+inline Allocator heap_allocator = { heap_allocate, heap_reallocate, heap_deallocate };
+
+//
+// Cache line aligned heap. There is no aligned realloc so growing always copies.
+//
+inline void *cache_line_allocate(Allocator *, u64 size) {
+    size = align_forward(size ? size : 1, ALLOCATOR_CACHE_LINE);
+#if defined(_WIN32)
+    return _aligned_malloc(size, ALLOCATOR_CACHE_LINE);
+#else
+    void *memory = NULL;
+    if (posix_memalign(&memory, ALLOCATOR_CACHE_LINE, size) != 0) { return NULL; }
+    return memory;
+#endif
+}
+
+inline void cache_line_deallocate(Allocator *, void *memory, u64) {
+#if defined(_WIN32)
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+inline void *cache_line_reallocate(Allocator *allocator, void *memory, u64 old_size, u64 new_size) {
+    void *result = cache_line_allocate(allocator, new_size);
+    if (result) {
+        memcpy(result, memory, (old_size < new_size) ? old_size : new_size);
+        cache_line_deallocate(allocator, memory, old_size);
+    }
+    return result;
+}
+
+inline Allocator cache_line_allocator = { cache_line_allocate, cache_line_reallocate, cache_line_deallocate };
+
+//
+// Pages, for blocks big enough that the OS should hand them out directly. Sizes are rounded up to whole pages.
+// The memory comes zeroed. Where there is no page API wired up it comes from calloc instead.
+//
+inline void *page_allocate(u64 size) {
+    size = align_forward(size, ALLOCATOR_PAGE_SIZE);
+#if defined(_WIN32)
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#elif defined(__linux__)
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (memory == MAP_FAILED) ? NULL : memory;
+#else
+    return calloc(1, size);
+#endif
+}
+
+inline void page_deallocate(void *memory, u64 size) {
+    if (!memory) { return; }
+#if defined(_WIN32)
+    VirtualFree(memory, 0, MEM_RELEASE);
+#elif defined(__linux__)
+    munmap(memory, align_forward(size, ALLOCATOR_PAGE_SIZE));
+#else
+    free(memory);
+#endif
+}
+
+// Keeps the first min(old_size, new_size) bytes. On linux the kernel remaps the pages, nothing is copied and the
+// old and new block never both exist.
+inline void *page_reallocate(void *memory, u64 old_size, u64 new_size) {
+    if (!memory) { return page_allocate(new_size); }
+
+    old_size = align_forward(old_size, ALLOCATOR_PAGE_SIZE);
+    new_size = align_forward(new_size, ALLOCATOR_PAGE_SIZE);
+    if (old_size == new_size) { return memory; }
+
+#if defined(__linux__)
+    void *result = mremap(memory, old_size, new_size, MREMAP_MAYMOVE);
+    return (result == MAP_FAILED) ? NULL : result;
+#else
+    void *result = page_allocate(new_size);
+    if (result) {
+        memcpy(result, memory, (old_size < new_size) ? old_size : new_size);
+        page_deallocate(memory, old_size);
+    }
+    return result;
+#endif
+}
+
+//
+// Generic interface, NULL means heap_allocator.
+//
+inline void *allocator_allocate(Allocator *allocator, u64 size) {
+    if (!allocator) { allocator = &heap_allocator; }
+    return allocator->allocate(allocator, size);
+}
+
+inline void *allocator_reallocate(Allocator *allocator, void *memory, u64 old_size, u64 new_size) {
+    if (!allocator) { allocator = &heap_allocator; }
+    if (!memory)    { return allocator->allocate(allocator, new_size); }
+    return allocator->reallocate(allocator, memory, old_size, new_size);
+}
+
+inline void allocator_deallocate(Allocator *allocator, void *memory, u64 size) {
+    if (!memory) { return; }
+    if (!allocator) { allocator = &heap_allocator; }
+    allocator->deallocate(allocator, memory, size);
+}
+
+//
+// Arena
+//
+struct Arena_Block {
+    Arena_Block *next;
+    u64          capacity;
+    u64          used;
+    // The memory follows, aligned to ALLOCATOR_ALIGNMENT.
+};
+
+struct Arena {
+    Allocator    allocator;          // First, so an Arena * is an Allocator *.
+    Arena_Block *blocks     = NULL;  // Current block first.
+    u64          block_size = ARENA_DEFAULT_BLOCK_SIZE;
+    u8          *last       = NULL;  // Most recent allocation, the only one that can be freed or grown in place.
+};
+
+inline u8 *arena_block_memory(Arena_Block *block) {
+    return (u8 *)block + align_forward(sizeof(Arena_Block), ALLOCATOR_ALIGNMENT);
+}
+
+inline Arena_Block *arena_new_block(Arena *arena, u64 at_least) {
+    u64 capacity = (at_least > arena->block_size) ? at_least : arena->block_size;
+    auto *block  = (Arena_Block *)malloc(align_forward(sizeof(Arena_Block), ALLOCATOR_ALIGNMENT) + capacity);
+    assert(block);
+    block->next     = arena->blocks;
+    block->capacity = capacity;
+    block->used     = 0;
+    arena->blocks   = block;
+    return block;
+}
+
+inline void *arena_allocate(Allocator *allocator, u64 size) {
+    Arena *arena = (Arena *)allocator;
+    size = align_forward(size ? size : 1, ALLOCATOR_ALIGNMENT);
+
+    Arena_Block *block = arena->blocks;
+    if (!block || block->used + size > block->capacity) { block = arena_new_block(arena, size); }
+
+    u8 *result   = arena_block_memory(block) + block->used;
+    block->used += size;
+    arena->last  = result;
+    return result;
+}
+
+inline void *arena_reallocate(Allocator *allocator, void *memory, u64 old_size, u64 new_size) {
+    Arena       *arena = (Arena *)allocator;
+    Arena_Block *block = arena->blocks;
+
+    // The most recent allocation can grow or shrink where it is if the block has room.
+    if (memory == arena->last && block) {
+        u64 offset = (u8 *)memory - arena_block_memory(block);
+        u64 size   = align_forward(new_size ? new_size : 1, ALLOCATOR_ALIGNMENT);
+        if (offset + size <= block->capacity) {
+            block->used = offset + size;
+            return memory;
+        }
+    }
+
+    if (new_size <= old_size) { return memory; }
+
+    void *result = arena_allocate(allocator, new_size);
+    memcpy(result, memory, old_size);
+    return result;
+}
+
+inline void arena_deallocate(Allocator *allocator, void *memory, u64) {
+    Arena *arena = (Arena *)allocator;
+    if (memory == arena->last && arena->blocks) {
+        arena->blocks->used = (u8 *)memory - arena_block_memory(arena->blocks);
+        arena->last         = NULL;
+    }
+}
+
+inline void arena_init(Arena *arena, u64 block_size=ARENA_DEFAULT_BLOCK_SIZE) {
+    arena->allocator  = { arena_allocate, arena_reallocate, arena_deallocate };
+    arena->blocks     = NULL;
+    arena->block_size = block_size;
+    arena->last       = NULL;
+}
+
+// Releases everything allocated from the arena. Keeps the biggest block around for the next round so a steady
+// workload stops calling malloc after the first request.
+inline void arena_reset(Arena *arena) {
+    Arena_Block *keep = NULL;
+    Arena_Block *block = arena->blocks;
+    while (block) {
+        Arena_Block *next = block->next;
+        if (!keep || block->capacity > keep->capacity) {
+            if (keep) { free(keep); }
+            keep = block;
+        } else {
+            free(block);
+        }
+        block = next;
+    }
+
+    if (keep) {
+        keep->next = NULL;
+        keep->used = 0;
+        // Later blocks are at least this big.
+        if (keep->capacity > arena->block_size) { arena->block_size = keep->capacity; }
+    }
+    arena->blocks = keep;
+    arena->last   = NULL;
+}
+
+inline void arena_deinit(Arena *arena) {
+    Arena_Block *block = arena->blocks;
+    while (block) {
+        Arena_Block *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+    arena->last   = NULL;
+}
+
+// Bytes handed out since the last reset, padding included.
+inline u64 arena_used(Arena *arena) {
+    u64 used = 0;
+    for (Arena_Block *block = arena->blocks; block; block = block->next) { used += block->used; }
+    return used;
+}
+
+//
+// Pool
+//
+struct Pool_Chunk {
+    Pool_Chunk *next;
+};
+
+struct Pool_Allocator {
+    Allocator   allocator;         // First, so a Pool_Allocator * is an Allocator *.
+    u64         block_size = 0;
+    void       *free_list  = NULL; // Each free block holds a pointer to the next one.
+    Pool_Chunk *chunks     = NULL;
+};
+
+inline void *pool_allocate(Allocator *allocator, u64 size) {
+    Pool_Allocator *pool = (Pool_Allocator *)allocator;
+    if (size > pool->block_size) { return malloc(size); }
+
+    if (!pool->free_list) {
+        u64 header = align_forward(sizeof(Pool_Chunk), ALLOCATOR_ALIGNMENT);
+        auto *chunk = (Pool_Chunk *)malloc(header + pool->block_size * POOL_BLOCKS_PER_CHUNK);
+        assert(chunk);
+        chunk->next  = pool->chunks;
+        pool->chunks = chunk;
+
+        u8 *memory = (u8 *)chunk + header;
+        for (s64 i = POOL_BLOCKS_PER_CHUNK - 1; i >= 0; --i) {
+            void *block = memory + i * pool->block_size;
+            *(void **)block = pool->free_list;
+            pool->free_list = block;
+        }
+    }
+
+    void *result    = pool->free_list;
+    pool->free_list = *(void **)result;
+    return result;
+}
+
+inline void pool_deallocate(Allocator *allocator, void *memory, u64 size) {
+    Pool_Allocator *pool = (Pool_Allocator *)allocator;
+    if (size > pool->block_size) { free(memory); return; }
+
+    *(void **)memory = pool->free_list;
+    pool->free_list  = memory;
+}
+
+inline void *pool_reallocate(Allocator *allocator, void *memory, u64 old_size, u64 new_size) {
+    Pool_Allocator *pool = (Pool_Allocator *)allocator;
+    bool was_pooled = old_size <= pool->block_size;
+    bool is_pooled  = new_size <= pool->block_size;
+
+    if (was_pooled && is_pooled) { return memory; }
+    if (!was_pooled && !is_pooled) { return realloc(memory, new_size); }
+
+    void *result = pool_allocate(allocator, new_size);
+    memcpy(result, memory, (old_size < new_size) ? old_size : new_size);
+    pool_deallocate(allocator, memory, old_size);
+    return result;
+}
+
+inline void pool_init(Pool_Allocator *pool, u64 block_size) {
+    pool->allocator  = { pool_allocate, pool_reallocate, pool_deallocate };
+    pool->block_size = align_forward((block_size < sizeof(void *)) ? sizeof(void *) : block_size, ALLOCATOR_ALIGNMENT);
+    pool->free_list  = NULL;
+    pool->chunks     = NULL;
+}
+
+// Frees every chunk. Blocks that went to the heap because they were too big are the caller's to free.
+inline void pool_deinit(Pool_Allocator *pool) {
+    Pool_Chunk *chunk = pool->chunks;
+    while (chunk) {
+        Pool_Chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    pool->chunks    = NULL;
+    pool->free_list = NULL;
+}
@@ -1,80 +1,245 @@
 #pragma once
 
 #include "Types.h"
+#include "Allocator.h"
 #include <assert.h>
-#include <string.h> 
+#include <stdlib.h> // abort
+#include <string.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <limits>
 
-#define MAX_ARRAY_INDEX 0x7fffffff
+#define ARRAY_GROWTH_FORMULA(x) (2*(s64)(x) + 8)
 
-#define ARRAY_GROWTH_FORMULA(x) (2*(x) + 8)
+// Arrays bigger than this grow by 1.5x in whole pages instead of doubling.
+#ifndef ARRAY_LARGE_THRESHOLD
+#define ARRAY_LARGE_THRESHOLD (1ull << 20)
+#endif
+
+// Heap arrays bigger than this are mapped straight from the OS and grown with mremap, see page_allocate.
+#ifndef ARRAY_PAGES_THRESHOLD
+#define ARRAY_PAGES_THRESHOLD (64ull << 20)
+#endif
+
+/**
+
+   Storage past 'size' is raw memory, elements are constructed when they're added and destroyed when they're
+   removed, so growing never default constructs the new capacity and never copies an owning type bit by bit.
+
+   Growing relocates the elements into the new block. For types that can be moved with a memcpy this is a
+   realloc, which can often extend the block in place and never runs a constructor. Everything else is move
+   constructed into the new block and the old elements are destroyed.
+
+   Is_Trivially_Relocatable picks the path at compile time. It's true for trivially copyable types; specialize it
+   for types that don't care where they live in memory (no pointers into themselves) to get the realloc path,
+   Array itself is one.
+
+   Memory comes from the Allocator given to array_init, the heap if there wasn't one. See Allocator.h.
+
+   Big_Array (Array <T, s64>) is for data sets past 2^31 elements. Any array past ARRAY_LARGE_THRESHOLD bytes
+   grows by 1.5x rounded to pages, and a heap array past ARRAY_PAGES_THRESHOLD bytes lives in pages mapped straight
+   from the OS. Growing that one is an mremap, the kernel moves page table entries and the old and new block
+   never both take up memory.
+
+**/
 
 template <typename T>
+struct Is_Trivially_Relocatable : std::is_trivially_copyable<T> {};
+
+// Index is s32 by default, Array <T, s64> (or Big_Array <T>) for arrays that can pass 2^31 elements.
+template <typename T, typename Index = s32>
 struct Array {
-    T *data      = NULL;
-    s32 size     = 0;  // The index is always size-1 when size isn't 0.
-    s32 capacity = 0;
-    
+    typedef Index Index_Type;
+
+    T *data        = NULL;
+    Index size     = 0;  // The index is always size-1 when size isn't 0.
+    Index capacity = 0;
+
     // Queue tracking
-    s32 front = 0;
+    Index front = 0;
+
+    Allocator *allocator = NULL; // NULL is the heap.
 
-    T &operator [](const s32 index) {
-        assert(index >= 0); 
-        assert(index < MAX_ARRAY_INDEX);
-        assert((s32)index < size); 
-        return data[index]; 
+    T &operator [](const Index index) {
+        assert(index >= 0);
+        assert(index < size);
+        return data[index];
     }
 
-    const T &operator [](const s32 index) const { 
-        assert(index >= 0); 
-        assert (index < MAX_ARRAY_INDEX);
-        assert((s32)index < size);
+    const T &operator [](const Index index) const {
+        assert(index >= 0);
+        assert(index < size);
         return data[index];
     }
 
-    // Iterator on the class itself. 
-    T *begin() { 
+    // Iterator on the class itself.
+    T *begin() {
         if (!data) { return NULL; } // For symmetry with the rest of the iterator calls.
         return data;
     }
-        
-    T *begin() const { 
+
+    T *begin() const {
         if (!data) { return NULL; }
         return data;
     }
-        
-    T *end() { 
+
+    T *end() {
         if (!data) { return NULL; }
         return data + size;
     }
-        
-    T *end() const { 
+
+    T *end() const {
         if (!data) { return NULL; }
         return data + size;
     }
 
 };
 
+template <typename T, typename Index>
+struct Is_Trivially_Relocatable <Array <T, Index>> : std::true_type {};
+
 template <typename T>
-void array_init(Array <T> *array) { 
-    auto default_capacity = ARRAY_GROWTH_FORMULA(0);
-    array->data = new T[default_capacity]{};
-    array->capacity = default_capacity;
-    array->front = 0;
+using Big_Array = Array <T, s64>;
+
+//
+// Internal functions
+//
+
+// Moves count elements from source into the uninitialized destination and ends the lifetime of the sources.
+template <typename T>
+inline void array_relocate(T *destination, T *source, s64 count) {
+    if (Is_Trivially_Relocatable<T>::value) {
+        if (count) { memcpy((void *)destination, (void *)source, count*sizeof(T)); }
+    } else {
+        for (s64 i = 0; i < count; ++i) {
+            new (&destination[i]) T(std::move(source[i]));
+            source[i].~T();
+        }
+    }
 }
 
 template <typename T>
-void array_init(Array <T> *array, s32 size) { 
-    if (size > 0) { 
-        array->data     = new T[size]{};
-        array->size     = size;
-        array->capacity = size;
+inline void array_destroy(T *data, s64 count) {
+    if (!std::is_trivially_destructible<T>::value) {
+        for (s64 i = 0; i < count; ++i) { data[i].~T(); }
+    }
+}
+
+// Blocks this big skip the allocator and come straight from the OS, see page_allocate. Only when the array uses
+// the heap, an array given an arena stays in the arena.
+inline bool array_uses_pages(Allocator *allocator, u64 bytes) {
+    return !allocator && bytes >= ARRAY_PAGES_THRESHOLD;
+}
+
+inline void array_free_block(Allocator *allocator, void *data, u64 bytes) {
+    if (array_uses_pages(allocator, bytes)) {
+        page_deallocate(data, bytes);
+    } else {
+        allocator_deallocate(allocator, data, bytes);
     }
 }
 
+// Doubles while the array is small. Past ARRAY_LARGE_THRESHOLD it grows by half and in whole pages, so the
+// slack on a huge array stays bounded and a grow doesn't need twice the memory.
 template <typename T>
-void array_deinit(Array <T> *array) { 
-    if (array->data) { 
-        delete[] array->data; 
+inline s64 array_next_capacity(s64 capacity) {
+    u64 bytes = (u64)capacity*sizeof(T);
+    if (bytes < ARRAY_LARGE_THRESHOLD) { return ARRAY_GROWTH_FORMULA(capacity); }
+
+    u64 new_bytes = align_forward(bytes + bytes/2, ALLOCATOR_PAGE_SIZE);
+    return (s64)(new_bytes / sizeof(T));
+}
+
+template <typename T, typename Index>
+static void array_allocate_and_copy(Array <T, Index> *array, s64 new_capacity) {
+    // The capacity never shrinks, that would invalidate possible iterators.
+    if (new_capacity <= (s64)array->capacity) { return; }
+    assert(new_capacity <= (s64)std::numeric_limits<Index>::max());
+
+    u64 old_bytes = (u64)array->capacity*sizeof(T);
+    u64 new_bytes = (u64)new_capacity*sizeof(T);
+
+    bool old_pages = array_uses_pages(array->allocator, old_bytes);
+    bool new_pages = array_uses_pages(array->allocator, new_bytes);
+
+    if (new_pages) { // Use every byte of the last page.
+        new_bytes    = align_forward(new_bytes, ALLOCATOR_PAGE_SIZE);
+        new_capacity = new_bytes / sizeof(T);
+        if (new_capacity > (s64)std::numeric_limits<Index>::max()) {
+            // The block has to stay exactly capacity elements, page_reallocate and the free get that size back.
+            new_capacity = std::numeric_limits<Index>::max();
+            new_bytes    = (u64)new_capacity*sizeof(T);
+        }
+    }
+
+    T *new_data = NULL;
+    if (Is_Trivially_Relocatable<T>::value && old_pages == new_pages) {
+        new_data = new_pages ? (T *)page_reallocate((void *)array->data, old_bytes, new_bytes)
+                             : (T *)allocator_reallocate(array->allocator, (void *)array->data, old_bytes, new_bytes);
+        assert(new_data);
+    } else {
+        new_data = new_pages ? (T *)page_allocate(new_bytes) : (T *)allocator_allocate(array->allocator, new_bytes);
+        assert(new_data);
+        array_relocate(new_data, array->data, array->size);
+        array_free_block(array->allocator, (void *)array->data, old_bytes);
+    }
+
+    array->data     = new_data;
+    array->capacity = (Index)new_capacity;
+}
+
+template <typename T, typename Index>
+static void array_mutate(Array <T, Index> *array, s64 want_capacity) {
+    // Past the largest Index the capacity would wrap negative. Stop for good instead of relying on an assert,
+    // release builds would carry on writing out of bounds.
+    const s64 max_capacity = (s64)std::numeric_limits<Index>::max();
+    if (want_capacity > max_capacity || (s64)array->capacity == max_capacity) { abort(); }
+
+    s64 new_capacity = array_next_capacity<T>((s64)array->capacity);
+    if (new_capacity < want_capacity) {
+        new_capacity = want_capacity;
+    }
+    if (new_capacity > max_capacity) {
+        new_capacity = max_capacity;
+    }
+    array_allocate_and_copy(array, new_capacity);
+}
+
+//
+// Interface
+//
+template <typename T, typename Index>
+void array_init(Array <T, Index> *array, Allocator *allocator=NULL) {
+    auto default_capacity = ARRAY_GROWTH_FORMULA(0);
+    array->data      = NULL;
+    array->size      = 0;
+    array->capacity  = 0;
+    array->front     = 0;
+    array->allocator = allocator;
+    array_allocate_and_copy(array, default_capacity);
+}
+
+// Starts out with size value initialized elements.
+template <typename T, typename Index>
+void array_init(Array <T, Index> *array, typename Array <T, Index>::Index_Type size, Allocator *allocator=NULL) {
+    array->data      = NULL;
+    array->size      = 0;
+    array->capacity  = 0;
+    array->front     = 0;
+    array->allocator = allocator;
+    if (size > 0) {
+        array_allocate_and_copy(array, size);
+        for (Index i = 0; i < size; ++i) { new (&array->data[i]) T(); }
+        array->size = size;
+    }
+}
+
+template <typename T, typename Index>
+void array_deinit(Array <T, Index> *array) {
+    if (array->data) {
+        array_destroy(array->data, array->size);
+        array_free_block(array->allocator, (void *)array->data, (u64)array->capacity*sizeof(T));
         array->data = NULL;
     }
     array->size     = 0;
@@ -82,64 +247,92 @@ void array_deinit(Array <T> *array) {
     array->front    = 0;
 }
 
-template <typename T>
-void array_reserve(Array <T> *array, s32 want_capacity) { 
+template <typename T, typename Index>
+void array_reserve(Array <T, Index> *array, typename Array <T, Index>::Index_Type want_capacity) {
     // Do nothing if the want_capacity is smaller than the current capacity
     if (array->capacity >= want_capacity) { return; }
 
     array_allocate_and_copy(array, want_capacity);
 }
 
-template <typename T> 
-void array_add(Array <T> *array, const T &value) { 
-    // If we do not have enough space in the array then we 
-    // need to apply the growth formula and copy over the data.
-    if (array->capacity == array->size) { 
+// Constructs a new element at the end from args, no temporary and no copy.
+template <typename T, typename Index, typename... Args>
+T &array_emplace(Array <T, Index> *array, Args &&... args) {
+    // If we do not have enough space in the array then we
+    // need to apply the growth formula and move over the data.
+    if (array->capacity == array->size) {
         array_mutate(array, 0); // We don't want to expand by much.
     }
-    
-    array->data[array->size] = value;
+
+    T *result = new (&array->data[array->size]) T(std::forward<Args>(args)...);
     array->size++;
+    return *result;
+}
+
+template <typename T, typename Index>
+void array_add(Array <T, Index> *array, const T &value) {
+    // value may live in the array itself, growing would leave the reference dangling.
+    if (array->capacity == array->size && &value >= array->data && &value < array->data + array->size) {
+        T copy(value);
+        array_emplace(array, std::move(copy));
+        return;
+    }
+    array_emplace(array, value);
+}
+
+template <typename T, typename Index>
+void array_add(Array <T, Index> *array, T &&value) {
+    if (array->capacity == array->size && &value >= array->data && &value < array->data + array->size) {
+        T moved(std::move(value));
+        array_emplace(array, std::move(moved));
+        return;
+    }
+    array_emplace(array, std::move(value));
 }
 
 // Same as pop but doesn't decrement the size
-template <typename T>
-inline T &array_peek(Array <T> *array) { 
-    assert(array->size > 0); 
+template <typename T, typename Index>
+inline T &array_peek(Array <T, Index> *array) {
+    assert(array->size > 0);
     T &result = array->data[array->size-1];
-    return result; 
+    return result;
 }
 
 // Same as peek but returns a pointer.
-template <typename T>
-inline T *array_peek_pointer(Array <T> *array) { 
-    assert(array->size > 0); 
-    T *result = &array->data[array->size-1]; 
-    return result; 
+template <typename T, typename Index>
+inline T *array_peek_pointer(Array <T, Index> *array) {
+    assert(array->size > 0);
+    T *result = &array->data[array->size-1];
+    return result;
 }
 
 
 // Here for completeness with array_pop();
-template <typename T> 
-inline void array_push(Array <T> *array, const T &value) { 
+template <typename T, typename Index>
+inline void array_push(Array <T, Index> *array, const T &value) {
     array_add(array, value);
 }
 
-template <typename T>
-inline T &array_peek_front(Array <T> *array) { 
-    assert(array->size > 0); 
+template <typename T, typename Index>
+inline void array_push(Array <T, Index> *array, T &&value) {
+    array_add(array, std::move(value));
+}
+
+template <typename T, typename Index>
+inline T &array_peek_front(Array <T, Index> *array) {
+    assert(array->size > 0);
     T &result = array->data[array->front];
     return result;
 }
 
-template <typename T>
-inline T &array_peek_back(Array <T> *array) { 
+template <typename T, typename Index>
+inline T &array_peek_back(Array <T, Index> *array) {
     return array_peek(array);
 }
 
-template <typename T> 
-inline T &array_pop_front(Array <T> *array) { 
-    assert(array->size > 0); 
+template <typename T, typename Index>
+inline T &array_pop_front(Array <T, Index> *array) {
+    assert(array->size > 0);
     T &result = array->data[0];
     // Eeeeh
     ~array->data[0];
@@ -147,47 +340,15 @@ inline T &array_pop_front(Array <T> *array) {
     return result;
 }
 
-//
-// Internal functions
-//
-template <typename T>
-static void array_mutate(Array <T> *array, s32 want_capacity) {
-    s32 new_capacity = ARRAY_GROWTH_FORMULA(array->capacity);
-    if (new_capacity < want_capacity) {
-        new_capacity = want_capacity;
-    }
-    array_allocate_and_copy(array, new_capacity);
-}
-
-template <typename T>
-void array_resize(Array <T> *array, s32 size) { 
-    array_allocate_and_copy(array, size);
-    array->size = size;
-}
+// Grows or shrinks to exactly size elements. New elements are value initialized, removed ones are destroyed.
+template <typename T, typename Index>
+void array_resize(Array <T, Index> *array, typename Array <T, Index>::Index_Type size) {
+    if (size > array->capacity) { array_allocate_and_copy(array, size); }
 
-template <typename T>
-static void array_allocate_and_copy(Array <T> *array, s32 new_capacity) { 
-    // If the capacities are the same then don't do anything.
-    if (new_capacity == array->capacity) { return; }
-
-    // If we want to resize the array to a smaller capacity.
-    // Here capacity and size are overloaded since we are shrinking.
-    if (new_capacity < array->capacity) {
-        auto old_size = array->size;
-        auto new_size = new_capacity;
-        auto bytes_to_clear = (old_size - new_size)*sizeof(T);
-        memset(array->data+new_size, 0x00, bytes_to_clear);
-        // Don't update the capacity as this will invalidate 
-        // possible iterators. 
-        return;
-    }
-
-    if (new_capacity > array->capacity) { 
-        T *new_data = new T[new_capacity];
-        memcpy(new_data, array->data, array->size*sizeof(T));
-        delete[] array->data;
-        array->data     = new_data;
-        array->capacity = new_capacity;
-        return;
+    if (size > array->size) {
+        for (Index i = array->size; i < size; ++i) { new (&array->data[i]) T(); }
+    } else {
+        array_destroy(array->data + size, array->size - size);
     }
+    array->size = size;
 }
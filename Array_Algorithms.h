@@ -0,0 +1,463 @@
+#pragma once
+
+#include "Types.h"
+#include "Array.h"
+#include "Thread_Pool.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define ARRAY_SIMD 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_WIN32)
+#include <intrin.h>
+#endif
+
+/**
+
+   Bulk algorithms over Array.
+
+       array_sort       LSD radix sort for integer and enum elements, stable merge sort for everything else.
+       array_find       index of the first element equal to value, -1 if there is none.
+       array_count      number of elements equal to value.
+       array_fill       assigns value to every element.
+       array_reduce     folds every element into one result.
+       array_remove_if  removes the elements pred is true for, keeping the rest in order.
+
+   find and count compare 16 bytes at a time with SSE2 for integers, enums, pointers, floats and doubles, and fall
+   back to operator== for everything else.
+
+   Every call takes an optional Thread_Pool. With one, the array is cut into chunks of at least
+   ARRAY_PARALLEL_GRAIN elements that run through parallel_for, so the calling thread works too and it is fine to
+   call from inside a task. Without one, or for arrays smaller than a couple of chunks, it all runs on the caller.
+
+**/
+
+#ifndef ARRAY_PARALLEL_GRAIN
+#define ARRAY_PARALLEL_GRAIN 16384
+#endif
+
+// Below this many elements array_sort just calls std::sort or std::stable_sort.
+#define ARRAY_SORT_SMALL 256
+
+//
+// Internal functions
+//
+
+// How many chunks to cut count elements into: one per ARRAY_PARALLEL_GRAIN, at most a few per thread so
+// parallel_for can balance them.
+inline s64 array_chunk_count(Thread_Pool *thread_pool, s64 count) {
+    if (!thread_pool || count < 2 * ARRAY_PARALLEL_GRAIN) { return 1; }
+    s64 chunks = count / ARRAY_PARALLEL_GRAIN;
+    s64 limit  = (thread_pool->number_of_threads + 1) * 4;
+    return (chunks < limit) ? chunks : limit;
+}
+
+// Chunks differ in size by at most one element.
+inline s64 array_chunk_begin(s64 count, s64 chunks, s64 chunk) {
+    s64 remainder = count % chunks;
+    return chunk * (count / chunks) + ((chunk < remainder) ? chunk : remainder);
+}
+
+// Calls function(chunk, begin, end) for every chunk, in parallel if there is more than one.
+template <typename Function>
+void array_for_chunks(Thread_Pool *thread_pool, s64 count, s64 chunks, Function &&function) {
+    if (chunks <= 1) {
+        function((s64)0, (s64)0, count);
+        return;
+    }
+    parallel_for(thread_pool, 0, chunks, 1, [&](s64 chunk) {
+        function(chunk, array_chunk_begin(count, chunks, chunk), array_chunk_begin(count, chunks, chunk + 1));
+    });
+}
+
+inline s32 array_count_trailing_zeros(u32 x) {
+#if defined(_WIN32)
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (s32)index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+inline s32 array_popcount(u32 x) {
+#if defined(_WIN32)
+    return (s32)__popcnt(x);
+#else
+    return __builtin_popcount(x);
+#endif
+}
+
+// Which SIMD kernel handles T. 0 is none, 1 compares integer lanes of sizeof(T) bytes, 2 floats, 3 doubles.
+template <typename T>
+struct Array_Simd_Kind {
+    static const s32 value =
+        std::is_same<T, f32>::value ? 2 :
+        std::is_same<T, f64>::value ? 3 :
+        ((std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value) &&
+         (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)) ? 1 : 0;
+};
+
+#if ARRAY_SIMD
+inline __m128i simd_broadcast(const void *value, s32 size) {
+    switch (size) {
+    case 1:  { u8  v; memcpy(&v, value, 1); return _mm_set1_epi8((char)v); }
+    case 2:  { u16 v; memcpy(&v, value, 2); return _mm_set1_epi16((short)v); }
+    case 4:  { u32 v; memcpy(&v, value, 4); return _mm_set1_epi32((int)v); }
+    default: { u64 v; memcpy(&v, value, 8); return _mm_set1_epi64x((long long)v); }
+    }
+}
+
+// One bit per byte of the 16 that matched, all of a lane's bytes are set when the lane matched.
+inline u32 simd_match_mask(__m128i block, __m128i needle, s32 size) {
+    switch (size) {
+    case 1:  return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+    case 2:  return (u32)_mm_movemask_epi8(_mm_cmpeq_epi16(block, needle));
+    case 4:  return (u32)_mm_movemask_epi8(_mm_cmpeq_epi32(block, needle));
+    default: {
+        // SSE2 has no 64 bit compare: both 32 bit halves have to match.
+        __m128i equal = _mm_cmpeq_epi32(block, needle);
+        equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+        return (u32)_mm_movemask_epi8(equal);
+    }
+    }
+}
+
+// Returns a mask with one bit per lane.
+template <typename T>
+inline u32 simd_lane_mask(const T *data, const T &value) {
+    const s32 kind = Array_Simd_Kind<T>::value;
+    if (kind == 2) {
+        f32 v; memcpy(&v, &value, 4);
+        return (u32)_mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps((const f32 *)(const void *)data), _mm_set1_ps(v)));
+    }
+    if (kind == 3) {
+        f64 v; memcpy(&v, &value, 8);
+        return (u32)_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd((const f64 *)(const void *)data), _mm_set1_pd(v)));
+    }
+
+    u32 bytes = simd_match_mask(_mm_loadu_si128((const __m128i *)(const void *)data), simd_broadcast(&value, sizeof(T)), sizeof(T));
+    if (sizeof(T) == 1) { return bytes; }
+
+    // Keep the lowest bit of each lane.
+    u32 lanes = 0;
+    for (s32 lane = 0; lane < (s32)(16 / sizeof(T)); ++lane) {
+        if (bytes & (1u << (lane * sizeof(T)))) { lanes |= 1u << lane; }
+    }
+    return lanes;
+}
+#endif
+
+template <typename T>
+s64 array_find_range(const T *data, s64 begin, s64 end, const T &value) {
+    s64 i = begin;
+#if ARRAY_SIMD
+    if (Array_Simd_Kind<T>::value) {
+        const s64 lanes = 16 / sizeof(T);
+        for (; i + lanes <= end; i += lanes) {
+            u32 mask = simd_lane_mask(data + i, value);
+            if (mask) { return i + array_count_trailing_zeros(mask); }
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        if (data[i] == value) { return i; }
+    }
+    return -1;
+}
+
+template <typename T>
+s64 array_count_range(const T *data, s64 begin, s64 end, const T &value) {
+    s64 count = 0;
+    s64 i     = begin;
+#if ARRAY_SIMD
+    if (Array_Simd_Kind<T>::value) {
+        const s64 lanes = 16 / sizeof(T);
+        for (; i + lanes <= end; i += lanes) {
+            count += array_popcount(simd_lane_mask(data + i, value));
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        if (data[i] == value) { ++count; }
+    }
+    return count;
+}
+
+// Integer keys as unsigned so that byte order is sort order: signed values get their sign bit flipped.
+template <typename T>
+inline u64 array_radix_key(const T &value) {
+    typedef typename std::conditional<std::is_enum<T>::value, std::underlying_type<T>, std::common_type<T>>::type::type Integer;
+    u64 key = (u64)(Integer)value;
+    if (std::is_signed<Integer>::value) { key ^= 1ull << (sizeof(T) * 8 - 1); }
+    return key;
+}
+
+template <typename T>
+void array_radix_sort(T *data, s64 count, Thread_Pool *thread_pool) {
+    static_assert(std::is_trivially_copyable<T>::value, "Radix sort moves elements with memcpy.");
+
+    T *scratch = (T *)malloc(count * sizeof(T));
+    assert(scratch);
+
+    s64  chunks     = array_chunk_count(thread_pool, count);
+    s64 *histograms = (s64 *)malloc(chunks * 256 * sizeof(s64));
+    assert(histograms);
+
+    T *source      = data;
+    T *destination = scratch;
+
+    for (s32 pass = 0; pass < (s32)sizeof(T); ++pass) {
+        s32 shift = pass * 8;
+
+        array_for_chunks(thread_pool, count, chunks, [&](s64 chunk, s64 begin, s64 end) {
+            s64 *histogram = histograms + chunk * 256;
+            memset(histogram, 0, 256 * sizeof(s64));
+            for (s64 i = begin; i < end; ++i) { histogram[(array_radix_key(source[i]) >> shift) & 0xff]++; }
+        });
+
+        // Skip the pass if every key has the same byte here, common for the high bytes of small numbers.
+        bool trivial = false;
+        for (s32 bucket = 0; bucket < 256; ++bucket) {
+            s64 total = 0;
+            for (s64 chunk = 0; chunk < chunks; ++chunk) { total += histograms[chunk * 256 + bucket]; }
+            if (total == count) { trivial = true; }
+            if (total) { break; }
+        }
+        if (trivial) { continue; }
+
+        // Turn the counts into where each chunk starts writing each bucket. Chunks write in order inside a
+        // bucket so the sort stays stable.
+        s64 offset = 0;
+        for (s32 bucket = 0; bucket < 256; ++bucket) {
+            for (s64 chunk = 0; chunk < chunks; ++chunk) {
+                s64 n = histograms[chunk * 256 + bucket];
+                histograms[chunk * 256 + bucket] = offset;
+                offset += n;
+            }
+        }
+
+        array_for_chunks(thread_pool, count, chunks, [&](s64 chunk, s64 begin, s64 end) {
+            s64 *offsets = histograms + chunk * 256;
+            for (s64 i = begin; i < end; ++i) {
+                destination[offsets[(array_radix_key(source[i]) >> shift) & 0xff]++] = source[i];
+            }
+        });
+
+        std::swap(source, destination);
+    }
+
+    if (source != data) { memcpy((void *)data, (void *)source, count * sizeof(T)); }
+
+    free(histograms);
+    free(scratch);
+}
+
+// Stable sort of each chunk, then rounds of pairwise merges with every pair of a round merged in parallel.
+template <typename T, typename Less>
+void array_merge_sort(T *data, s64 count, Less &less, Thread_Pool *thread_pool) {
+    s64 chunks = array_chunk_count(thread_pool, count);
+
+    array_for_chunks(thread_pool, count, chunks, [&](s64 chunk, s64 begin, s64 end) {
+        std::stable_sort(data + begin, data + end, less);
+    });
+    if (chunks == 1) { return; }
+
+    // The sorted runs move into the scratch buffer, so both buffers hold constructed elements and the merges can
+    // move assign between them.
+    T *scratch = (T *)malloc(count * sizeof(T));
+    assert(scratch);
+    for (s64 i = 0; i < count; ++i) { new (&scratch[i]) T(std::move(data[i])); }
+
+    T  *source      = scratch;
+    T  *destination = data;
+    s64 width       = 1; // In chunks.
+
+    while (width < chunks) {
+        s64 pairs = (chunks + 2 * width - 1) / (2 * width);
+        array_for_chunks(thread_pool, pairs, (thread_pool && pairs > 1) ? pairs : 1, [&](s64, s64 first_pair, s64 last_pair) {
+            for (s64 pair = first_pair; pair < last_pair; ++pair) {
+                s64 left   = array_chunk_begin(count, chunks, pair * 2 * width);
+                s64 middle = array_chunk_begin(count, chunks, std::min(chunks, pair * 2 * width + width));
+                s64 right  = array_chunk_begin(count, chunks, std::min(chunks, pair * 2 * width + 2 * width));
+                std::merge(std::make_move_iterator(source + left),   std::make_move_iterator(source + middle),
+                           std::make_move_iterator(source + middle), std::make_move_iterator(source + right),
+                           destination + left, less);
+            }
+        });
+        std::swap(source, destination);
+        width *= 2;
+    }
+
+    if (source != data) {
+        for (s64 i = 0; i < count; ++i) { data[i] = std::move(source[i]); }
+    }
+
+    array_destroy(scratch, count);
+    free(scratch);
+}
+
+template <typename T>
+inline void array_sort_dispatch(T *data, s64 count, Thread_Pool *thread_pool, std::true_type /* integer */) {
+    if (count < ARRAY_SORT_SMALL) {
+        std::sort(data, data + count);
+        return;
+    }
+    array_radix_sort(data, count, thread_pool);
+}
+
+template <typename T>
+inline void array_sort_dispatch(T *data, s64 count, Thread_Pool *thread_pool, std::false_type /* integer */) {
+    std::less<T> less;
+    if (count < ARRAY_SORT_SMALL) {
+        std::stable_sort(data, data + count, less);
+        return;
+    }
+    array_merge_sort(data, count, less, thread_pool);
+}
+
+//
+// Interface
+//
+
+// Sorts with operator<. Integer and enum elements get a radix sort, everything else a stable merge sort.
+template <typename T, typename Index>
+void array_sort(Array <T, Index> *array, Thread_Pool *thread_pool=NULL) {
+    s64 count = array->size;
+    if (count < 2) { return; }
+
+    typedef std::integral_constant<bool, (std::is_integral<T>::value || std::is_enum<T>::value) && !std::is_same<T, bool>::value> Is_Integer;
+    array_sort_dispatch(array->data, count, thread_pool, Is_Integer());
+}
+
+// Stable sort with less(a, b).
+template <typename T, typename Index, typename Less>
+void array_sort(Array <T, Index> *array, Less less, Thread_Pool *thread_pool=NULL) {
+    s64 count = array->size;
+    if (count < 2) { return; }
+
+    if (count < ARRAY_SORT_SMALL) {
+        std::stable_sort(array->data, array->data + count, less);
+        return;
+    }
+    array_merge_sort(array->data, count, less, thread_pool);
+}
+
+template <typename T, typename Index>
+s64 array_find(Array <T, Index> *array, const T &value, Thread_Pool *thread_pool=NULL) {
+    s64 count  = array->size;
+    s64 chunks = array_chunk_count(thread_pool, count);
+    if (chunks == 1) { return array_find_range(array->data, 0, count, value); }
+
+    // Chunks that start past the best match so far don't bother looking.
+    std::atomic<s64> best {count};
+    array_for_chunks(thread_pool, count, chunks, [&](s64, s64 begin, s64 end) {
+        if (begin >= best.load(std::memory_order_relaxed)) { return; }
+        s64 found = array_find_range(array->data, begin, end, value);
+        if (found < 0) { return; }
+        s64 current = best.load(std::memory_order_relaxed);
+        while (found < current && !best.compare_exchange_weak(current, found, std::memory_order_relaxed)) {}
+    });
+
+    s64 result = best.load(std::memory_order_relaxed);
+    return (result == count) ? -1 : result;
+}
+
+template <typename T, typename Index>
+s64 array_count(Array <T, Index> *array, const T &value, Thread_Pool *thread_pool=NULL) {
+    s64 count = array->size;
+    s64 chunks = array_chunk_count(thread_pool, count);
+    if (chunks == 1) { return array_count_range(array->data, 0, count, value); }
+
+    std::atomic<s64> total {0};
+    array_for_chunks(thread_pool, count, chunks, [&](s64, s64 begin, s64 end) {
+        total.fetch_add(array_count_range(array->data, begin, end, value), std::memory_order_relaxed);
+    });
+    return total.load(std::memory_order_relaxed);
+}
+
+template <typename T, typename Index>
+void array_fill(Array <T, Index> *array, const T &value, Thread_Pool *thread_pool=NULL) {
+    s64 count = array->size;
+    array_for_chunks(thread_pool, count, array_chunk_count(thread_pool, count), [&](s64, s64 begin, s64 end) {
+        if (sizeof(T) == 1 && std::is_trivially_copyable<T>::value) {
+            u8 byte;
+            memcpy(&byte, &value, 1);
+            memset((void *)(array->data + begin), byte, end - begin);
+        } else {
+            std::fill(array->data + begin, array->data + end, value);
+        }
+    });
+}
+
+// Left fold: result = op(result, element) for every element starting from init. With a thread pool every chunk
+// folds from init and the chunk results are folded together with op(Result, Result), so op has to be
+// associative, callable on two Results, and init has to be its identity.
+template <typename T, typename Index, typename Result, typename Op>
+Result array_reduce(Array <T, Index> *array, Result init, Op op, Thread_Pool *thread_pool=NULL) {
+    s64 count  = array->size;
+    s64 chunks = array_chunk_count(thread_pool, count);
+
+    if (chunks == 1) {
+        Result result = init;
+        for (s64 i = 0; i < count; ++i) { result = op(result, array->data[i]); }
+        return result;
+    }
+
+    Array <Result, s64> partials;
+    array_init(&partials, chunks);
+    array_for_chunks(thread_pool, count, chunks, [&](s64 chunk, s64 begin, s64 end) {
+        Result result = init;
+        for (s64 i = begin; i < end; ++i) { result = op(result, array->data[i]); }
+        partials[chunk] = result;
+    });
+
+    Result result = init;
+    for (s64 chunk = 0; chunk < chunks; ++chunk) { result = op(result, partials[chunk]); }
+    array_deinit(&partials);
+    return result;
+}
+
+// Removes every element pred(const T &) is true for, the rest keep their order. Returns how many were removed.
+// With a thread pool pred runs in parallel and only the compaction is serial, which is where the time goes when
+// pred is anything more than a compare.
+template <typename T, typename Index, typename Predicate>
+s64 array_remove_if(Array <T, Index> *array, Predicate pred, Thread_Pool *thread_pool=NULL) {
+    s64 count  = array->size;
+    s64 chunks = array_chunk_count(thread_pool, count);
+    T  *data   = array->data;
+
+    u8 *remove = NULL;
+    if (chunks > 1) {
+        remove = (u8 *)malloc(count);
+        assert(remove);
+        array_for_chunks(thread_pool, count, chunks, [&](s64, s64 begin, s64 end) {
+            for (s64 i = begin; i < end; ++i) { remove[i] = pred((const T &)data[i]) ? 1 : 0; }
+        });
+    }
+
+    s64 kept = 0;
+    for (s64 i = 0; i < count; ++i) {
+        bool removed = remove ? (remove[i] != 0) : pred((const T &)data[i]);
+        if (removed) { continue; }
+        if (kept != i) { data[kept] = std::move(data[i]); }
+        ++kept;
+    }
+
+    array_destroy(data + kept, count - kept);
+    array->size = (Index)kept;
+
+    if (remove) { free(remove); }
+    return count - kept;
+}
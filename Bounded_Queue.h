@@ -0,0 +1,303 @@
+#pragma once
+
+#include "Types.h"
+#include "Sync.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <utility>
+#include <assert.h>
+#include <stddef.h> // NULL
+
+/**
+
+   A fixed capacity lock free ring buffer for handing values between threads.
+
+   Queue.h is single threaded and grows forever, this one is the opposite: the capacity is set once, nothing is
+   allocated after bounded_queue_init and any number of threads can push and pop at the same time.
+
+       QUEUE_MPMC  any number of producers and consumers. Dmitry Vyukov's bounded queue: every cell carries a
+                   sequence number that says whose turn it is, so a push or a pop is one CAS on a position
+                   counter and never waits on another thread in the middle of its own operation.
+       QUEUE_MPSC  the same cells, but the one consumer owns the dequeue position and pops without a CAS.
+       QUEUE_SPSC  a plain ring with a head and a tail. Each side keeps a cached copy of the other side's index
+                   and only goes back to the shared cache line when the cache says the queue is full or empty.
+
+   The enqueue and dequeue positions live on separate cache lines so producers and consumers don't invalidate
+   each other on every operation.
+
+   bounded_queue_try_push / bounded_queue_try_pop never block and return false when the queue is full or empty.
+   bounded_queue_push / bounded_queue_pop spin for a while, then yield and then sleep until the other side makes
+   room. They wake each other straight away. A sleeper that is waiting on a try_ call instead notices within
+   BOUNDED_QUEUE_PARK_MICROSECONDS, so the non blocking calls don't have to pay for the check.
+
+**/
+
+#define BOUNDED_QUEUE_CACHE_LINE_SIZE 64
+
+#ifndef BOUNDED_QUEUE_SPIN_COUNT
+#define BOUNDED_QUEUE_SPIN_COUNT 1024
+#endif
+
+#ifndef BOUNDED_QUEUE_YIELD_COUNT
+#define BOUNDED_QUEUE_YIELD_COUNT 64
+#endif
+
+#ifndef BOUNDED_QUEUE_PARK_MICROSECONDS
+#define BOUNDED_QUEUE_PARK_MICROSECONDS 1000
+#endif
+
+enum BOUNDED_QUEUE_MODE : u8 {
+    QUEUE_MPMC = 0,
+    QUEUE_MPSC = 1,
+    QUEUE_SPSC = 2,
+};
+
+// Shared by every mode, only touched by the blocking calls.
+struct Bounded_Queue_Waiters {
+    std::mutex              mutex;
+    std::condition_variable condition;
+    std::atomic<s64>        sleepers {0};
+};
+
+template <typename T>
+struct Bounded_Queue_Cell {
+    std::atomic<s64> sequence;
+    T                value;
+};
+
+template <typename T, BOUNDED_QUEUE_MODE Mode = QUEUE_MPMC>
+struct Bounded_Queue {
+    alignas(BOUNDED_QUEUE_CACHE_LINE_SIZE) std::atomic<s64> enqueue_position {0};
+    alignas(BOUNDED_QUEUE_CACHE_LINE_SIZE) std::atomic<s64> dequeue_position {0};
+
+    alignas(BOUNDED_QUEUE_CACHE_LINE_SIZE) Bounded_Queue_Cell <T> *cells = NULL;
+    s64 capacity = 0; // Always a power of 2.
+
+    Bounded_Queue_Waiters waiters;
+};
+
+template <typename T>
+struct Bounded_Queue <T, QUEUE_SPSC> {
+    // Producer side. cached_head is the producer's last look at head.
+    alignas(BOUNDED_QUEUE_CACHE_LINE_SIZE) std::atomic<s64> tail {0};
+    s64 cached_head = 0;
+
+    // Consumer side. cached_tail is the consumer's last look at tail.
+    alignas(BOUNDED_QUEUE_CACHE_LINE_SIZE) std::atomic<s64> head {0};
+    s64 cached_tail = 0;
+
+    alignas(BOUNDED_QUEUE_CACHE_LINE_SIZE) T *items = NULL;
+    s64 capacity = 0; // Always a power of 2.
+
+    Bounded_Queue_Waiters waiters;
+};
+
+//
+// Internal functions
+//
+inline s64 bounded_queue_round_capacity(s64 capacity) {
+    s64 rounded = 2; // The sequence numbers need at least 2 cells to tell full from empty.
+    while (rounded < capacity) { rounded *= 2; }
+    return rounded;
+}
+
+// Called after a successful operation by the blocking calls. Both sides do a read-modify-write on sleepers:
+// if ours comes first the sleeper's retry sees our operation, if theirs comes first we see the sleeper.
+inline void bounded_queue_wake(Bounded_Queue_Waiters *waiters) {
+    if (waiters->sleepers.fetch_add(0, std::memory_order_acq_rel) > 0) {
+        std::unique_lock<std::mutex> lock(waiters->mutex);
+        waiters->condition.notify_all();
+    }
+}
+
+// Spins, yields and then sleeps until try_operation succeeds.
+template <typename Try_Operation>
+inline void bounded_queue_wait(Bounded_Queue_Waiters *waiters, Try_Operation &&try_operation) {
+    for (s64 i = 0; i < BOUNDED_QUEUE_SPIN_COUNT; ++i) {
+        if (try_operation()) { return; }
+        cpu_pause();
+    }
+
+    for (s64 i = 0; i < BOUNDED_QUEUE_YIELD_COUNT; ++i) {
+        if (try_operation()) { return; }
+        std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(waiters->mutex);
+    waiters->sleepers.fetch_add(1, std::memory_order_acq_rel);
+    while (!try_operation()) {
+        waiters->condition.wait_for(lock, std::chrono::microseconds(BOUNDED_QUEUE_PARK_MICROSECONDS));
+    }
+    waiters->sleepers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+//
+// Interface
+//
+
+// capacity is rounded up to a power of 2.
+template <typename T, BOUNDED_QUEUE_MODE Mode>
+void bounded_queue_init(Bounded_Queue <T, Mode> *queue, s64 capacity) {
+    assert(capacity > 0);
+    queue->capacity = bounded_queue_round_capacity(capacity);
+    queue->cells    = new Bounded_Queue_Cell <T>[queue->capacity];
+    for (s64 i = 0; i < queue->capacity; ++i) {
+        queue->cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    queue->enqueue_position.store(0, std::memory_order_relaxed);
+    queue->dequeue_position.store(0, std::memory_order_relaxed);
+}
+
+template <typename T>
+void bounded_queue_init(Bounded_Queue <T, QUEUE_SPSC> *queue, s64 capacity) {
+    assert(capacity > 0);
+    queue->capacity    = bounded_queue_round_capacity(capacity);
+    queue->items       = new T[queue->capacity];
+    queue->cached_head = 0;
+    queue->cached_tail = 0;
+    queue->tail.store(0, std::memory_order_relaxed);
+    queue->head.store(0, std::memory_order_relaxed);
+}
+
+// No other thread may be using the queue. Values still in it are destroyed.
+template <typename T, BOUNDED_QUEUE_MODE Mode>
+void bounded_queue_deinit(Bounded_Queue <T, Mode> *queue) {
+    if (queue->cells) {
+        delete[] queue->cells;
+        queue->cells = NULL;
+    }
+    queue->capacity = 0;
+}
+
+template <typename T>
+void bounded_queue_deinit(Bounded_Queue <T, QUEUE_SPSC> *queue) {
+    if (queue->items) {
+        delete[] queue->items;
+        queue->items = NULL;
+    }
+    queue->capacity = 0;
+}
+
+// Approximate while other threads are pushing and popping.
+template <typename T, BOUNDED_QUEUE_MODE Mode>
+inline s64 bounded_queue_size(Bounded_Queue <T, Mode> *queue) {
+    s64 size = queue->enqueue_position.load(std::memory_order_relaxed) - queue->dequeue_position.load(std::memory_order_relaxed);
+    return (size < 0) ? 0 : (size > queue->capacity) ? queue->capacity : size;
+}
+
+template <typename T>
+inline s64 bounded_queue_size(Bounded_Queue <T, QUEUE_SPSC> *queue) {
+    s64 size = queue->tail.load(std::memory_order_relaxed) - queue->head.load(std::memory_order_relaxed);
+    return (size < 0) ? 0 : (size > queue->capacity) ? queue->capacity : size;
+}
+
+// Moves value into the queue on success, leaves it untouched if the queue is full.
+template <typename T, BOUNDED_QUEUE_MODE Mode>
+inline bool bounded_queue_try_push(Bounded_Queue <T, Mode> *queue, T &value) {
+    Bounded_Queue_Cell <T> *cell;
+    s64 position = queue->enqueue_position.load(std::memory_order_relaxed);
+
+    while (true) {
+        cell = &queue->cells[position & (queue->capacity - 1)];
+        s64 sequence   = cell->sequence.load(std::memory_order_acquire);
+        s64 difference = sequence - position;
+
+        if (difference == 0) { // The cell is free for this lap, claim it.
+            if (queue->enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) { break; }
+        } else if (difference < 0) { // Still holds the value from the last lap, we're full.
+            return false;
+        } else { // Another producer got here first.
+            position = queue->enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->value = std::move(value);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+// QUEUE_MPSC: only one thread may pop.
+template <typename T, BOUNDED_QUEUE_MODE Mode>
+inline bool bounded_queue_try_pop(Bounded_Queue <T, Mode> *queue, T *out) {
+    Bounded_Queue_Cell <T> *cell;
+    s64 position = queue->dequeue_position.load(std::memory_order_relaxed);
+
+    if (Mode == QUEUE_MPSC) {
+        cell = &queue->cells[position & (queue->capacity - 1)];
+        if (cell->sequence.load(std::memory_order_acquire) - (position + 1) < 0) { return false; }
+        queue->dequeue_position.store(position + 1, std::memory_order_relaxed);
+    } else {
+        while (true) {
+            cell = &queue->cells[position & (queue->capacity - 1)];
+            s64 sequence   = cell->sequence.load(std::memory_order_acquire);
+            s64 difference = sequence - (position + 1);
+
+            if (difference == 0) { // Published and not yet taken.
+                if (queue->dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) { break; }
+            } else if (difference < 0) { // Nothing published here yet, we're empty.
+                return false;
+            } else { // Another consumer got here first.
+                position = queue->dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    *out = std::move(cell->value);
+    cell->sequence.store(position + queue->capacity, std::memory_order_release); // Free for the next lap.
+    return true;
+}
+
+// Producer thread only.
+template <typename T>
+inline bool bounded_queue_try_push(Bounded_Queue <T, QUEUE_SPSC> *queue, T &value) {
+    s64 tail = queue->tail.load(std::memory_order_relaxed);
+    if (tail - queue->cached_head >= queue->capacity) {
+        queue->cached_head = queue->head.load(std::memory_order_acquire);
+        if (tail - queue->cached_head >= queue->capacity) { return false; }
+    }
+
+    queue->items[tail & (queue->capacity - 1)] = std::move(value);
+    queue->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+// Consumer thread only.
+template <typename T>
+inline bool bounded_queue_try_pop(Bounded_Queue <T, QUEUE_SPSC> *queue, T *out) {
+    s64 head = queue->head.load(std::memory_order_relaxed);
+    if (head == queue->cached_tail) {
+        queue->cached_tail = queue->tail.load(std::memory_order_acquire);
+        if (head == queue->cached_tail) { return false; }
+    }
+
+    *out = std::move(queue->items[head & (queue->capacity - 1)]);
+    queue->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// Blocks until there is room.
+template <typename T, BOUNDED_QUEUE_MODE Mode>
+void bounded_queue_push(Bounded_Queue <T, Mode> *queue, T &value) {
+    if (!bounded_queue_try_push(queue, value)) {
+        bounded_queue_wait(&queue->waiters, [queue, &value]() { return bounded_queue_try_push(queue, value); });
+    }
+    bounded_queue_wake(&queue->waiters);
+}
+
+template <typename T, BOUNDED_QUEUE_MODE Mode>
+void bounded_queue_push(Bounded_Queue <T, Mode> *queue, T &&value) {
+    bounded_queue_push(queue, value);
+}
+
+// Blocks until there is something to pop.
+template <typename T, BOUNDED_QUEUE_MODE Mode>
+void bounded_queue_pop(Bounded_Queue <T, Mode> *queue, T *out) {
+    if (!bounded_queue_try_pop(queue, out)) {
+        bounded_queue_wait(&queue->waiters, [queue, out]() { return bounded_queue_try_pop(queue, out); });
+    }
+    bounded_queue_wake(&queue->waiters);
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "Types.h"
+#include "Allocator.h"
+#include "Hash_Table.h" // Default_Hash, Default_Equal, table_probe and table_erase.
+
+#include <assert.h>
+#include <new>
+#include <string.h>
+
+/**
+
+   A fixed capacity cache. cache_put never grows anything, once capacity keys are in it every new key evicts an
+   old one, so the memory is set at cache_init and stays there.
+
+       Cache <u64, Page> pages;
+       cache_init(&pages, 4096);
+
+       Page *page = cache_get(&pages, id);
+       if (!page) { cache_put(&pages, id, load_page(id)); }
+
+   Eviction is CLOCK: every slot has a referenced bit that cache_get sets, and a hand sweeps the slots clearing
+   bits until it finds one that is clear. That slot has not been used since the hand last went past it, which is
+   close to least recently used without moving anything on a hit. New keys start with the bit clear, so a key
+   that is put and never read again goes before the ones that are being read.
+
+   Keys and values live in one array of capacity slots and an open addressing index of slot numbers, twice the
+   capacity, finds them. Nothing is allocated per entry: keys and values are assigned into their slot, so only
+   a key type that allocates on its own (string) does. const char * keys are not copied, the caller keeps them
+   alive as long as they are in the cache, use string keys to have the cache own them.
+
+   A pointer from cache_get is good until the next cache_put or cache_remove. For a cache shared between threads
+   see Concurrent_Cache.
+
+**/
+
+struct Cache_Stats {
+    s64 hits;
+    s64 misses;
+    s64 evictions;
+};
+
+template <typename Key_Type, typename Value_Type, typename Hasher = Default_Hash<Key_Type>, typename Equal = Default_Equal<Key_Type>>
+struct Cache {
+    struct Slot {
+        u32        hash; // VACANT when the slot holds nothing.
+        Key_Type   key;
+        Value_Type value;
+    };
+
+    // The index is probed with Hash_Table's helpers, which look for hash and key fields.
+    struct Index_Entry {
+        u32 hash;
+        s32 key; // The slot.
+    };
+
+    s32 capacity;
+    s32 items;
+    s32 used;       // Slots handed out so far. Until it reaches capacity new keys take fresh slots, no eviction.
+    s32 hand;       // Next slot the clock looks at.
+    s32 index_size; // Power of 2, at least twice capacity.
+
+    Slot        *slots;
+    u8          *referenced; // One per slot, kept apart so the sweep reads a dense array.
+    Index_Entry *index;
+
+    Cache_Stats stats;
+
+    Hasher hasher;
+    Equal  equal;
+
+    Allocator *allocator; // Where the arrays come from, NULL is the heap.
+};
+
+//
+// Internal functions
+//
+
+// Never one of the HASH_STATE values, the same as Hash_Table.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup>
+inline u32 cache_hash(Cache <Key_Type, Value_Type, Hasher, Equal> *cache, const Lookup &key) {
+    u32 hash = cache->hasher(key);
+    if (hash < HASH_STATE::VALID) { hash += HASH_STATE::VALID; }
+    return hash;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup>
+inline typename Cache <Key_Type, Value_Type, Hasher, Equal>::Index_Entry *cache_find_entry(Cache <Key_Type, Value_Type, Hasher, Equal> *cache, u32 hash, const Lookup &key) {
+    return table_probe(cache->index, cache->index_size, hash, key, [cache](s32 slot, const Lookup &lookup) { return cache->equal(cache->slots[slot].key, lookup); });
+}
+
+// Empties slot and takes it out of the index.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void cache_clear_slot(Cache <Key_Type, Value_Type, Hasher, Equal> *cache, s32 slot) {
+    auto *entry = table_probe(cache->index, cache->index_size, cache->slots[slot].hash, slot, [](s32 a, s32 b) { return a == b; });
+    assert(entry);
+    table_erase(cache->index, cache->index_size, entry);
+
+    // Drops whatever the key and value own.
+    typedef typename Cache <Key_Type, Value_Type, Hasher, Equal>::Slot Slot;
+    cache->slots[slot].~Slot();
+    new (&cache->slots[slot]) Slot();
+    cache->slots[slot].hash = HASH_STATE::VACANT;
+    cache->items--;
+}
+
+// A slot for a new key, evicting one when the cache is full.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline s32 cache_take_slot(Cache <Key_Type, Value_Type, Hasher, Equal> *cache) {
+    if (cache->used < cache->capacity) { return cache->used++; }
+
+    // Clears at most capacity bits before it comes back round to one it cleared.
+    while (true) {
+        s32 slot    = cache->hand;
+        cache->hand = (cache->hand + 1 == cache->capacity) ? 0 : cache->hand + 1;
+
+        if (cache->slots[slot].hash == HASH_STATE::VACANT) { return slot; } // Left by cache_remove.
+        if (cache->referenced[slot]) {
+            cache->referenced[slot] = 0;
+            continue;
+        }
+
+        cache_clear_slot(cache, slot);
+        cache->stats.evictions++;
+        return slot;
+    }
+}
+
+//
+// Interface
+//
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void cache_init(Cache <Key_Type, Value_Type, Hasher, Equal> *cache, s32 capacity, Allocator *allocator=NULL) {
+    typedef typename Cache <Key_Type, Value_Type, Hasher, Equal>::Slot        Slot;
+    typedef typename Cache <Key_Type, Value_Type, Hasher, Equal>::Index_Entry Index_Entry;
+
+    assert(capacity > 0);
+    cache->capacity   = capacity;
+    cache->items      = 0;
+    cache->used       = 0;
+    cache->hand       = 0;
+    cache->index_size = (s32)next_power_of_two((u32)capacity * 2);
+    cache->stats      = {};
+    cache->allocator  = allocator;
+
+    cache->slots      = (Slot *)allocator_allocate(allocator, (u64)capacity * sizeof(Slot));
+    cache->referenced = (u8 *)allocator_allocate(allocator, (u64)capacity);
+    cache->index      = (Index_Entry *)allocator_allocate(allocator, (u64)cache->index_size * sizeof(Index_Entry));
+    assert(cache->slots && cache->referenced && cache->index);
+
+    for (s32 i = 0; i < capacity; ++i) {
+        new (&cache->slots[i]) Slot();
+        cache->slots[i].hash = HASH_STATE::VACANT;
+    }
+    memset(cache->referenced, 0, (u64)capacity);
+    memset((void *)cache->index, 0, (u64)cache->index_size * sizeof(Index_Entry));
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void cache_deinit(Cache <Key_Type, Value_Type, Hasher, Equal> *cache) {
+    typedef typename Cache <Key_Type, Value_Type, Hasher, Equal>::Slot        Slot;
+    typedef typename Cache <Key_Type, Value_Type, Hasher, Equal>::Index_Entry Index_Entry;
+
+    for (s32 i = 0; i < cache->capacity; ++i) { cache->slots[i].~Slot(); }
+    allocator_deallocate(cache->allocator, cache->slots, (u64)cache->capacity * sizeof(Slot));
+    allocator_deallocate(cache->allocator, cache->referenced, (u64)cache->capacity);
+    allocator_deallocate(cache->allocator, cache->index, (u64)cache->index_size * sizeof(Index_Entry));
+
+    cache->slots      = NULL;
+    cache->referenced = NULL;
+    cache->index      = NULL;
+    cache->items      = 0;
+}
+
+// The value of key, NULL on a miss. Counts a hit or a miss.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup>
+Value_Type *cache_get(Cache <Key_Type, Value_Type, Hasher, Equal> *cache, const Lookup &key) {
+    auto *entry = cache_find_entry(cache, cache_hash(cache, key), key);
+    if (!entry) {
+        cache->stats.misses++;
+        return NULL;
+    }
+
+    cache->stats.hits++;
+    cache->referenced[entry->key] = 1;
+    return &cache->slots[entry->key].value;
+}
+
+// Adds key or replaces its value. Replacing counts as a use, adding may evict.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void cache_put(Cache <Key_Type, Value_Type, Hasher, Equal> *cache, const Table_Key_Argument<Key_Type> &key, Value_Type value) {
+    u32   hash  = cache_hash(cache, key);
+    auto *entry = cache_find_entry(cache, hash, key);
+    if (entry) {
+        cache->slots[entry->key].value = value;
+        cache->referenced[entry->key]  = 1;
+        return;
+    }
+
+    // The slot is empty, so the key and value are copy constructed into it rather than assigned.
+    typedef typename Cache <Key_Type, Value_Type, Hasher, Equal>::Slot Slot;
+    s32 slot = cache_take_slot(cache);
+    cache->slots[slot].~Slot();
+    new (&cache->slots[slot]) Slot { hash, key, value };
+    cache->referenced[slot] = 0;
+
+    entry       = table_vacant_entry(cache->index, cache->index_size, hash);
+    entry->hash = hash;
+    entry->key  = slot;
+    cache->items++;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup>
+bool cache_remove(Cache <Key_Type, Value_Type, Hasher, Equal> *cache, const Lookup &key) {
+    auto *entry = cache_find_entry(cache, cache_hash(cache, key), key);
+    if (!entry) { return false; }
+    cache_clear_slot(cache, entry->key);
+    return true;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "Types.h"
+#include "Allocator.h"
+#include "Cache.h"
+#include "Sync.h"
+
+#include <assert.h>
+#include <new>
+#include <thread>
+
+/**
+
+   Cache for many threads, striped the same way as Concurrent_Hash_Table: the keys are split over a power of 2
+   number of shards by the top bits of their hash, and each shard is a Cache behind its own Mutex. Each shard
+   evicts on its own, so it is CLOCK per shard rather than over the whole cache, which is close enough with
+   evenly spread hashes.
+
+       Concurrent_Cache <u64, Page> pages;
+       cache_init(&pages, 1 << 20);
+
+       Page page;
+       if (!cache_get(&pages, id, &page)) { page = load_page(id); cache_put(&pages, id, page); }
+
+   The capacity is split evenly over the shards, rounded up, so the cache holds at most capacity plus
+   shard_count - 1 keys. cache_get copies the value out, nothing points into a shard once its lock is dropped.
+
+**/
+
+#ifndef CONCURRENT_CACHE_MIN_SHARD_CAPACITY
+#define CONCURRENT_CACHE_MIN_SHARD_CAPACITY 64 // Smaller shards evict too much by chance, fewer shards are used.
+#endif
+
+template <typename Key_Type, typename Value_Type, typename Hasher = Default_Hash<Key_Type>, typename Equal = Default_Equal<Key_Type>>
+struct Concurrent_Cache {
+    struct alignas(ALLOCATOR_CACHE_LINE) Shard {
+        Mutex mutex;
+        Cache <Key_Type, Value_Type, Hasher, Equal> cache;
+    };
+
+    Shard *shards      = NULL;
+    s32    shard_count = 0;  // Power of 2.
+    s32    shard_shift = 32; // 32 - log2(shard_count), the top bits of the hash pick the shard.
+
+    Hasher hasher;
+};
+
+//
+// Internal functions
+//
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup>
+inline typename Concurrent_Cache <Key_Type, Value_Type, Hasher, Equal>::Shard *cache_shard(Concurrent_Cache <Key_Type, Value_Type, Hasher, Equal> *cache, const Lookup &key) {
+    u32 hash  = cache->hasher(key);
+    u32 index = (cache->shard_shift >= 32) ? 0 : (hash >> cache->shard_shift);
+    return &cache->shards[index];
+}
+
+//
+// Interface
+//
+
+// shard_count 0 picks 4 per hardware thread, fewer if that leaves shards under
+// CONCURRENT_CACHE_MIN_SHARD_CAPACITY.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void cache_init(Concurrent_Cache <Key_Type, Value_Type, Hasher, Equal> *cache, s32 capacity, s32 shard_count=0, Allocator *allocator=NULL) {
+    assert(capacity > 0);
+    if (shard_count <= 0) {
+        s32 threads = (s32)std::thread::hardware_concurrency();
+        shard_count = (threads > 0 ? threads : 1) * 4;
+        while (shard_count > 1 && capacity / shard_count < CONCURRENT_CACHE_MIN_SHARD_CAPACITY) { shard_count /= 2; }
+    }
+    shard_count = (s32)next_power_of_two((u32)shard_count);
+
+    cache->shard_count = shard_count;
+    cache->shard_shift = 32;
+    for (s32 n = shard_count; n > 1; n >>= 1) { cache->shard_shift--; }
+
+    typedef typename Concurrent_Cache <Key_Type, Value_Type, Hasher, Equal>::Shard Shard;
+    cache->shards = (Shard *)allocator_allocate(&cache_line_allocator, (u64)shard_count * sizeof(Shard));
+    assert(cache->shards);
+
+    s32 shard_capacity = (capacity + shard_count - 1) / shard_count;
+    for (s32 i = 0; i < shard_count; ++i) {
+        Shard *shard = new (&cache->shards[i]) Shard;
+        mutex_create(&shard->mutex);
+        cache_init(&shard->cache, shard_capacity, allocator);
+    }
+}
+
+// No other thread may be using the cache.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void cache_deinit(Concurrent_Cache <Key_Type, Value_Type, Hasher, Equal> *cache) {
+    typedef typename Concurrent_Cache <Key_Type, Value_Type, Hasher, Equal>::Shard Shard;
+    for (s32 i = 0; i < cache->shard_count; ++i) {
+        Shard *shard = &cache->shards[i];
+        cache_deinit(&shard->cache);
+        mutex_destroy(&shard->mutex);
+        shard->~Shard();
+    }
+    allocator_deallocate(&cache_line_allocator, cache->shards, (u64)cache->shard_count * sizeof(Shard));
+    cache->shards      = NULL;
+    cache->shard_count = 0;
+}
+
+// Copies the value into *value on a hit. value can be NULL to only check, which still counts as a use.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup>
+bool cache_get(Concurrent_Cache <Key_Type, Value_Type, Hasher, Equal> *cache, const Lookup &key, Value_Type *value) {
+    auto *shard = cache_shard(cache, key);
+    Scoped_Lock lock(&shard->mutex);
+
+    Value_Type *found = cache_get(&shard->cache, key);
+    if (found && value) { *value = *found; }
+    return found != NULL;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void cache_put(Concurrent_Cache <Key_Type, Value_Type, Hasher, Equal> *cache, const Table_Key_Argument<Key_Type> &key, Value_Type value) {
+    auto *shard = cache_shard(cache, key);
+    Scoped_Lock lock(&shard->mutex);
+    cache_put(&shard->cache, key, value);
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup>
+bool cache_remove(Concurrent_Cache <Key_Type, Value_Type, Hasher, Equal> *cache, const Lookup &key) {
+    auto *shard = cache_shard(cache, key);
+    Scoped_Lock lock(&shard->mutex);
+    return cache_remove(&shard->cache, key);
+}
+
+// Counters summed over the shards, each locked in turn.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+Cache_Stats cache_stats(Concurrent_Cache <Key_Type, Value_Type, Hasher, Equal> *cache) {
+    Cache_Stats stats = {};
+    for (s32 i = 0; i < cache->shard_count; ++i) {
+        Scoped_Lock lock(&cache->shards[i].mutex);
+        stats.hits      += cache->shards[i].cache.stats.hits;
+        stats.misses    += cache->shards[i].cache.stats.misses;
+        stats.evictions += cache->shards[i].cache.stats.evictions;
+    }
+    return stats;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "Types.h"
+#include "Allocator.h"
+#include "Hash_Table.h"
+#include "Sync.h"
+
+#include <assert.h>
+#include <new>
+#include <thread>
+
+/**
+
+   A Hash_Table that many threads can use at once, by lock striping: the keys are split over a power of 2 number
+   of shards, each an ordinary Hash_Table behind its own Mutex. Two threads only wait on each other when their keys
+   land in the same shard, so with a few shards per thread most calls never contend. Every shard sits on its own
+   cache lines so locking one doesn't slow down its neighbours.
+
+   The shard comes from the high bits of the key's hash and the slot inside the shard from the low bits, so the
+   two don't correlate.
+
+   Nothing hands out pointers into the table, another thread could move or remove the entry right after.
+   table_find copies the value out while the shard is locked, and table_update runs a function on the value in
+   place under the lock for read-modify-write.
+
+       Concurrent_Hash_Table <u64, Session> sessions;
+       table_init(&sessions);
+
+       Session session;
+       if (table_find(&sessions, id, &session)) { ... }
+       table_update(&sessions, id, [](Session *s) { s->hits++; });
+
+   Readers take the shard lock too. An optimistic seqlock read was considered, but a shard can reallocate its
+   entries while a reader is probing them, so readers would need epoch based reclamation on top (see
+   Lock_Free_Hash_Map for that).
+
+**/
+
+#ifndef CONCURRENT_TABLE_SHARDS_PER_THREAD
+#define CONCURRENT_TABLE_SHARDS_PER_THREAD 4
+#endif
+
+template <typename Key_Type, typename Value_Type, typename Hasher = Default_Hash<Key_Type>, typename Equal = Default_Equal<Key_Type>>
+struct Concurrent_Hash_Table {
+    struct alignas(ALLOCATOR_CACHE_LINE) Shard {
+        Mutex mutex;
+        Hash_Table <Key_Type, Value_Type, Hasher, Equal> table;
+    };
+
+    Shard *shards      = NULL;
+    s32    shard_count = 0;  // Power of 2.
+    s32    shard_shift = 32; // 32 - log2(shard_count), the top bits of the hash pick the shard.
+
+    Hasher hasher;
+};
+
+//
+// Internal functions
+//
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup>
+inline typename Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal>::Shard *table_shard(Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup &key) {
+    u32 hash = table->hasher(key);
+    // Shifting a u32 by 32 is undefined, a single shard takes no bits.
+    u32 index = (table->shard_shift >= 32) ? 0 : (hash >> table->shard_shift);
+    return &table->shards[index];
+}
+
+//
+// Interface
+//
+
+// shard_count 0 picks CONCURRENT_TABLE_SHARDS_PER_THREAD per hardware thread. table_size is spread over the
+// shards.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void table_init(Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, s32 shard_count=0, s64 table_size=0) {
+    if (shard_count <= 0) {
+        s32 threads = (s32)std::thread::hardware_concurrency();
+        shard_count = (threads > 0 ? threads : 1) * CONCURRENT_TABLE_SHARDS_PER_THREAD;
+    }
+    shard_count = (s32)next_power_of_two((u32)shard_count);
+
+    table->shard_count = shard_count;
+    table->shard_shift = 32;
+    for (s32 n = shard_count; n > 1; n >>= 1) { table->shard_shift--; }
+
+    typedef typename Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal>::Shard Shard;
+    table->shards = (Shard *)allocator_allocate(&cache_line_allocator, (u64)shard_count * sizeof(Shard));
+    assert(table->shards);
+
+    s64 shard_size = table_size / shard_count;
+    for (s32 i = 0; i < shard_count; ++i) {
+        Shard *shard = new (&table->shards[i]) Shard;
+        mutex_create(&shard->mutex);
+        table_init(&shard->table, shard_size);
+    }
+}
+
+// No other thread may be using the table.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void table_deinit(Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table) {
+    typedef typename Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal>::Shard Shard;
+    for (s32 i = 0; i < table->shard_count; ++i) {
+        Shard *shard = &table->shards[i];
+        table_deinit(&shard->table);
+        mutex_destroy(&shard->mutex);
+        shard->~Shard();
+    }
+    allocator_deallocate(&cache_line_allocator, table->shards, (u64)table->shard_count * sizeof(Shard));
+    table->shards      = NULL;
+    table->shard_count = 0;
+}
+
+// Copies the value into *value when key is there. value can be NULL to only check.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+bool table_find(Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key, Value_Type *value=NULL) {
+    auto *shard = table_shard(table, key);
+    Scoped_Lock lock(&shard->mutex);
+
+    Value_Type *found = table_find_pointer(&shard->table, key);
+    if (found && value) { *value = *found; }
+    return found != NULL;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void table_set(Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key, Value_Type value) {
+    auto *shard = table_shard(table, key);
+    Scoped_Lock lock(&shard->mutex);
+    table_set(&shard->table, key, value);
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+bool table_remove(Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key) {
+    auto *shard = table_shard(table, key);
+    Scoped_Lock lock(&shard->mutex);
+    return table_remove(&shard->table, key);
+}
+
+// Calls function(Value_Type *) on key's value with its shard locked. Returns false if key isn't there. Keep the
+// function short, everything else hashing to that shard waits for it.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Function>
+bool table_update(Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key, Function &&function) {
+    auto *shard = table_shard(table, key);
+    Scoped_Lock lock(&shard->mutex);
+
+    Value_Type *found = table_find_pointer(&shard->table, key);
+    if (found) { function(found); }
+    return found != NULL;
+}
+
+// Sum over the shards, each locked in turn. Only a snapshot when other threads are writing.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+s64 table_items(Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table) {
+    s64 items = 0;
+    for (s32 i = 0; i < table->shard_count; ++i) {
+        Scoped_Lock lock(&table->shards[i].mutex);
+        items += table->shards[i].table.items;
+    }
+    return items;
+}
+
+// Lookups by any type the hasher takes, see Hash_Table.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+bool table_find(Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup &key, Value_Type *value=NULL) {
+    auto *shard = table_shard(table, key);
+    Scoped_Lock lock(&shard->mutex);
+
+    Value_Type *found = table_find_pointer(&shard->table, key);
+    if (found && value) { *value = *found; }
+    return found != NULL;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+bool table_remove(Concurrent_Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup &key) {
+    auto *shard = table_shard(table, key);
+    Scoped_Lock lock(&shard->mutex);
+    return table_remove(&shard->table, key);
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "Types.h"
+#include "Allocator.h"
+#include "Array.h"
+#include "Sync.h"
+
+#include <assert.h>
+#include <atomic>
+#include <thread>
+
+/**
+
+   Epoch based reclamation, for containers whose readers don't take a lock. A writer that unlinks memory a
+   reader might still be looking at hands it to epoch_retire instead of freeing it, and it is freed once every
+   reader that could have seen it has left.
+
+       u64 epoch = epoch_enter(&epoch_domain);      // or Epoch_Scope scope(&epoch_domain);
+       Node *node = shared.load(std::memory_order_acquire);
+       ... read node ...
+       epoch_exit(&epoch_domain, epoch);
+
+       Node *old = shared.exchange(new_node);
+       epoch_retire(&epoch_domain, old, sizeof(Node), allocator);
+
+   There is a global epoch and three reader counts per stripe, one for each of the epochs that can have readers
+   at once. A reader counts itself in the current epoch of its stripe, and the global epoch only moves on from e
+   to e+1 once nobody is left counted in e-1. Memory retired in epoch e is freed when the global epoch reaches e+2:
+   everyone who entered in e or before has left by then, and later readers can't find it anymore.
+
+   Threads pick a stripe the first time they enter, round robin, and each stripe has its own cache line. Up to
+   EPOCH_STRIPES threads every reader only ever writes its own line, so reads scale with the cores. Past that
+   threads share stripes, which is still correct, just slower.
+
+   Nothing needs registering, a thread can start reading at any time. Readers must not block inside a read
+   section for long, that holds back every free in the domain.
+
+**/
+
+#ifndef EPOCH_STRIPES
+#define EPOCH_STRIPES 64
+#endif
+
+#define EPOCH_RECLAIM_BATCH 64 // Retires between automatic attempts to move the epoch on and free.
+
+struct alignas(ALLOCATOR_CACHE_LINE) Epoch_Stripe {
+    std::atomic<s64> readers[3];
+};
+
+struct Epoch_Retired {
+    void      *memory;
+    u64        size;
+    Allocator *allocator;
+    u64        epoch; // Global epoch at the time it was retired.
+};
+
+struct Epoch {
+    std::atomic<u64> global_epoch;
+    char             padding[ALLOCATOR_CACHE_LINE - sizeof(std::atomic<u64>)]; // Readers only read this line.
+
+    Epoch_Stripe stripes[EPOCH_STRIPES];
+
+    Mutex                 retired_mutex;
+    Array <Epoch_Retired> retired;
+    s32                   retired_since_reclaim;
+};
+
+//
+// Internal functions
+//
+inline Epoch_Stripe *epoch_stripe(Epoch *epoch) {
+    static std::atomic<u32> next_stripe = {0};
+    static thread_local u32 stripe      = next_stripe.fetch_add(1, std::memory_order_relaxed) % EPOCH_STRIPES;
+    return &epoch->stripes[stripe];
+}
+
+inline s64 epoch_readers(Epoch *epoch, u64 e) {
+    s64 readers = 0;
+    for (s32 i = 0; i < EPOCH_STRIPES; ++i) {
+        readers += epoch->stripes[i].readers[e % 3].load(std::memory_order_acquire);
+    }
+    return readers;
+}
+
+// Moves the global epoch on by one if nobody is still in the one before it.
+inline bool epoch_try_advance(Epoch *epoch) {
+    // Pairs with the fence in epoch_enter: either we see the reader's count, or the reader sees whatever was
+    // unlinked before this.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    u64 e = epoch->global_epoch.load(std::memory_order_seq_cst);
+    if (e > 0 && epoch_readers(epoch, e - 1) != 0) { return false; }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    epoch->global_epoch.compare_exchange_strong(e, e + 1, std::memory_order_seq_cst);
+    return true;
+}
+
+// Frees everything retired at least two epochs ago. retired_mutex must be held.
+inline void epoch_free_retired(Epoch *epoch) {
+    u64 e = epoch->global_epoch.load(std::memory_order_seq_cst);
+
+    s32 kept = 0;
+    for (s32 i = 0; i < epoch->retired.size; ++i) {
+        Epoch_Retired *retired = &epoch->retired.data[i];
+        if (retired->epoch + 2 <= e) {
+            allocator_deallocate(retired->allocator, retired->memory, retired->size);
+        } else {
+            epoch->retired.data[kept++] = *retired;
+        }
+    }
+    epoch->retired.size = kept;
+}
+
+//
+// Interface
+//
+inline void epoch_init(Epoch *epoch) {
+    epoch->global_epoch.store(1, std::memory_order_relaxed);
+    for (s32 i = 0; i < EPOCH_STRIPES; ++i) {
+        for (s32 j = 0; j < 3; ++j) { epoch->stripes[i].readers[j].store(0, std::memory_order_relaxed); }
+    }
+
+    mutex_create(&epoch->retired_mutex);
+    array_init(&epoch->retired);
+    epoch->retired_since_reclaim = 0;
+}
+
+// Frees everything still retired, no thread may be reading anymore.
+inline void epoch_deinit(Epoch *epoch) {
+    for (s32 i = 0; i < epoch->retired.size; ++i) {
+        Epoch_Retired *retired = &epoch->retired.data[i];
+        allocator_deallocate(retired->allocator, retired->memory, retired->size);
+    }
+    array_deinit(&epoch->retired);
+    mutex_destroy(&epoch->retired_mutex);
+}
+
+// Starts a read section. Returns the epoch to give back to epoch_exit. Sections can nest.
+inline u64 epoch_enter(Epoch *epoch) {
+    Epoch_Stripe *stripe = epoch_stripe(epoch);
+    while (true) {
+        u64 e = epoch->global_epoch.load(std::memory_order_relaxed);
+        stripe->readers[e % 3].fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // If the epoch moved on in between, the count may have landed in a slot the writer already checked.
+        if (epoch->global_epoch.load(std::memory_order_relaxed) == e) { return e; }
+        stripe->readers[e % 3].fetch_sub(1, std::memory_order_release);
+    }
+}
+
+inline void epoch_exit(Epoch *epoch, u64 e) {
+    epoch_stripe(epoch)->readers[e % 3].fetch_sub(1, std::memory_order_release);
+}
+
+// Frees memory (from allocator, NULL is the heap) once no reader can be looking at it anymore. Call after the
+// memory has been unlinked from everything readers can reach, with seq_cst stores (the default). The free
+// happens in whichever later retire, epoch_reclaim or epoch_synchronize gets to it, on that thread, so allocator
+// must be safe to free into from there.
+inline void epoch_retire(Epoch *epoch, void *memory, u64 size, Allocator *allocator=NULL) {
+    if (!memory) { return; }
+
+    Scoped_Lock lock(&epoch->retired_mutex);
+
+    Epoch_Retired retired;
+    retired.memory    = memory;
+    retired.size      = size;
+    retired.allocator = allocator;
+    retired.epoch     = epoch->global_epoch.load(std::memory_order_seq_cst);
+    array_add(&epoch->retired, retired);
+
+    if (++epoch->retired_since_reclaim >= EPOCH_RECLAIM_BATCH) {
+        epoch->retired_since_reclaim = 0;
+        epoch_try_advance(epoch);
+        epoch_free_retired(epoch);
+    }
+}
+
+// Tries to move the epoch on and frees what it can, without waiting for readers.
+inline void epoch_reclaim(Epoch *epoch) {
+    Scoped_Lock lock(&epoch->retired_mutex);
+    epoch_try_advance(epoch);
+    epoch_try_advance(epoch);
+    epoch_free_retired(epoch);
+}
+
+// Waits until every read section that was running when this was called has left, then frees everything that
+// was retired before. Must not be called from inside a read section.
+inline void epoch_synchronize(Epoch *epoch) {
+    u64 target = epoch->global_epoch.load(std::memory_order_seq_cst) + 2;
+    while (epoch->global_epoch.load(std::memory_order_seq_cst) < target) {
+        if (!epoch_try_advance(epoch)) { std::this_thread::yield(); }
+    }
+
+    Scoped_Lock lock(&epoch->retired_mutex);
+    epoch_free_retired(epoch);
+}
+
+// A read section for the rest of the scope.
+struct Epoch_Scope {
+    Epoch *epoch;
+    u64    entered;
+
+    Epoch_Scope(Epoch *_epoch) {
+        epoch   = _epoch;
+        entered = epoch_enter(epoch);
+    }
+
+    ~Epoch_Scope() {
+        epoch_exit(epoch, entered);
+    }
+};
+
+// Shared by every container that isn't given its own.
+inline Epoch *epoch_global() {
+    static Epoch *epoch = [] {
+        Epoch *result = new Epoch;
+        epoch_init(result);
+        return result;
+    }();
+    return epoch;
+}
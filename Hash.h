@@ -1,11 +1,52 @@
 #pragma once
 
+#include "Types.h"
+
+#include <string.h> // memcpy
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define HASH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if HASH_SSE2 && (defined(__GNUC__) || defined(_MSC_VER))
+#define HASH_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(_WIN32)
+#include <intrin.h>
+#endif
+
+/**
+
+   murmur_32 is the original 32 bit hash, kept for anything that already stores its values.
+
+   hash_64 is the one to use for new code. It reads 8 or 16 bytes at a time on short keys and runs 8 64 bit lanes
+   over 64 byte stripes on long ones, with SSE2 or AVX2 picked at runtime for the lanes. Every path gives the
+   same value for the same input, so hashes can be stored and compared across machines (little endian ones).
+
+       u64 h = hash_64(data, length);
+
+       Hash_64_State state;
+       hash_64_init(&state);
+       hash_64_update(&state, header, header_length);
+       hash_64_update(&state, body, body_length);
+       u64 same_as_hashing_both_in_one_go = hash_64_final(&state);
+
+   It isn't a cryptographic hash, don't use it where someone could pick the keys to make them collide.
+
+   hash_mix_32 and hash_mix_64 are for keys that already are a number: a couple of multiplies and shifts that
+   spread every input bit over the whole result. They're constexpr so constant keys hash at compile time.
+
+**/
+
 // Murmur32 hash implementation
 
 const u32 SEED = 0x58bc4716;
 
 inline
-u32 murmur_32(void *data, s32 len) { 
+u32 murmur_32(void *data, s32 len) {
     const u32 c1 = 0xcc9e2d51;
     const u32 c2 = 0x1b873593;
     const u32 r1 = 15;
@@ -19,30 +60,30 @@ u32 murmur_32(void *data, s32 len) {
     u32 hash = SEED;
     u32 k = 0;
 
-    u32 *d = (u32 *)data;
+    u8 *d = (u8 *)data;
     s32 nblocks = len / 4;
-    
-    u8 *tail = (u8 *)d+nblocks*4;
-    
+
+    u8 *tail = d+nblocks*4;
+
     // Groups of 4 bytes.
     for (int i = 0; i < nblocks; ++i) {
-        k = d[i];
+        memcpy(&k, d + i*4, 4); // Keys aren't necessarily aligned.
         k *= c1;
         k = (k << r1)  | (k >> (32 - r1));
         k *= c2;
 
         hash ^= k;
-        hash = ((hash << r2) | (hash >> (32 - r2)))*m+n;  
+        hash = ((hash << r2) | (hash >> (32 - r2)))*m+n;
     }
-    
-    // Read the rest 
+
+    // Read the rest
     k = 0;
     switch (len & 3) {
     case 3:  // Fall through
         k ^= tail[2] << 16;
     case 2:  // Fall through
         k ^= tail[1] << 8;
-    case 1: 
+    case 1:
         k ^= tail[0];
         k *= c1;
         k = (k << r1) | (k >> (32 - r1));
@@ -61,4 +102,342 @@ u32 murmur_32(void *data, s32 len) {
     return hash;
 }
 
+//
+// Integer mixers
+//
+
+// lowbias32 by Chris Wellons.
+constexpr u32 hash_mix_32(u32 x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// The splitmix64 finalizer.
+constexpr u64 hash_mix_64(u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+//
+// hash_64
+//
+#define HASH_64_STRIPE           64                     // Bytes per stripe, one per lane.
+#define HASH_64_STRIPES_PER_BLOCK 16
+#define HASH_64_BLOCK            (HASH_64_STRIPE * HASH_64_STRIPES_PER_BLOCK)
+#define HASH_64_MID_MAX          128                    // Longest input that skips the lanes.
+
+const u64 HASH_64_PRIME_1 = 0x9e3779b185ebca87ull;
+const u64 HASH_64_PRIME_2 = 0xc2b2ae3d27d4eb4full;
+const u64 HASH_64_PRIME_3 = 0x165667b19e3779f9ull;
+const u64 HASH_64_PRIME_4 = 0x85ebca77c2b2ae63ull;
+const u64 HASH_64_PRIME_5 = 0x27d4eb2f165667c5ull;
+const u32 HASH_64_PRIME32 = 0x9e3779b1u;
+
+// Stripe n of a block is keyed with secret[n .. n+7], the block scramble uses secret[16 .. 23].
+const u64 HASH_64_SECRET[24] = {
+    0x6069dc34c267fd44ull, 0x2490e2b313882090ull, 0x8951a6debe510c6dull, 0x44638d00d2432840ull,
+    0xc947182bb48b11eeull, 0x16c14c760debdf52ull, 0xb84b0a4ddb0f227bull, 0xf6dfce0595b193ebull,
+    0x75f400411f4e358bull, 0xc118aafe201a5ddeull, 0x2a7d19ae24f69a09ull, 0x6ab0dbaf3f396619ull,
+    0xd1f9c4019789b0b7ull, 0x3649ad3d0b3f0704ull, 0xb4edcbf882697615ull, 0x054d159df4cf31d2ull,
+    0x46abdc4c6140caf5ull, 0x9befe914e1111478ull, 0x3324f48e7833ba99ull, 0x8b0a1dd3d7fe084aull,
+    0x7bf70c37b7b95b3eull, 0xb00f8581abbaec84ull, 0xd3bea38aadfc81d3ull, 0x7597ab562e465021ull,
+};
+
+struct Hash_64_State {
+    u64 lanes[8];
+    u64 seed;
+    u64 length;   // Bytes seen so far.
+    u64 buffered; // Bytes of the current block sitting in buffer.
 
+    // The current block. Once a block has been consumed its last stripe stays at the end of the buffer, the
+    // final stripe of the input may need it.
+    alignas(64) u8 buffer[HASH_64_BLOCK];
+};
+
+//
+// Internal functions
+//
+inline u64 hash_read_64(const u8 *p) { u64 v; memcpy(&v, p, 8); return v; }
+inline u32 hash_read_32(const u8 *p) { u32 v; memcpy(&v, p, 4); return v; }
+
+// 64x64 -> 128 bit multiply, low half xor high half.
+inline u64 hash_multiply_fold(u64 a, u64 b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t product = (__uint128_t)a * b;
+    return (u64)product ^ (u64)(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    u64 high;
+    u64 low = _umul128(a, b, &high);
+    return low ^ high;
+#else
+    u64 a_lo = (u32)a, a_hi = a >> 32, b_lo = (u32)b, b_hi = b >> 32;
+    u64 lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    u64 cross = (lo_lo >> 32) + (u32)hi_lo + lo_hi;
+    u64 high  = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    u64 low   = (cross << 32) | (u32)lo_lo;
+    return low ^ high;
+#endif
+}
+
+inline u64 hash_byte_swap(u64 x) {
+#if defined(_MSC_VER)
+    return _byteswap_uint64(x);
+#else
+    return __builtin_bswap64(x);
+#endif
+}
+
+inline u64 hash_avalanche(u64 h) {
+    h ^= h >> 37;
+    h *= 0x165667919e3779f9ull;
+    h ^= h >> 32;
+    return h;
+}
+
+inline u64 hash_mix_16(const u8 *p, const u64 *secret, u64 seed) {
+    return hash_multiply_fold(hash_read_64(p) ^ (secret[0] + seed), hash_read_64(p + 8) ^ (secret[1] - seed));
+}
+
+// 0 to 16 bytes: pack them into two words and fold them together.
+inline u64 hash_64_short(const u8 *p, u64 length, u64 seed) {
+    u64 a = 0, b = 0;
+    if (length > 8) {
+        a = hash_read_64(p);
+        b = hash_read_64(p + length - 8);
+    } else if (length >= 4) {
+        a = ((u64)hash_read_32(p) << 32) | hash_read_32(p + length - 4);
+    } else if (length > 0) {
+        a = ((u64)p[0] << 16) | ((u64)p[length >> 1] << 24) | p[length - 1] | (length << 8);
+    }
+
+    u64 lo = a ^ (HASH_64_SECRET[0] + seed);
+    u64 hi = b ^ (HASH_64_SECRET[1] - seed);
+    u64 acc = length + hash_byte_swap(lo) + hi + hash_multiply_fold(lo, hi);
+    return hash_avalanche(acc);
+}
+
+// 17 to HASH_64_MID_MAX bytes: 16 byte pairs from both ends, working inwards.
+inline u64 hash_64_mid(const u8 *p, u64 length, u64 seed) {
+    u64 acc = length * HASH_64_PRIME_1;
+    u64 pairs = (length - 1) / 32;
+    for (u64 i = 0; i <= pairs; ++i) {
+        acc += hash_mix_16(p + 16 * i, HASH_64_SECRET + 4 * i, seed);
+        acc += hash_mix_16(p + length - 16 * (i + 1), HASH_64_SECRET + 4 * i + 2, seed);
+    }
+    return hash_avalanche(acc);
+}
+
+// Adds stripes of 64 bytes into the 8 lanes, stripe n keyed with secret + n.
+typedef void (*Hash_Accumulate_Proc)(u64 *lanes, const u8 *data, u64 stripes, const u64 *secret);
+
+inline void hash_accumulate_scalar(u64 *lanes, const u8 *data, u64 stripes, const u64 *secret) {
+    for (u64 s = 0; s < stripes; ++s) {
+        const u8 *stripe = data + s * HASH_64_STRIPE;
+        for (s32 i = 0; i < 8; ++i) {
+            u64 value = hash_read_64(stripe + 8 * i);
+            u64 keyed = value ^ secret[s + i];
+            lanes[i ^ 1] += value;
+            lanes[i]     += (u64)(u32)keyed * (keyed >> 32);
+        }
+    }
+}
+
+#if HASH_SSE2
+inline void hash_accumulate_sse2(u64 *lanes, const u8 *data, u64 stripes, const u64 *secret) {
+    __m128i acc[4];
+    for (s32 j = 0; j < 4; ++j) { acc[j] = _mm_loadu_si128((const __m128i *)(lanes + 2 * j)); }
+
+    for (u64 s = 0; s < stripes; ++s) {
+        const u8 *stripe = data + s * HASH_64_STRIPE;
+        for (s32 j = 0; j < 4; ++j) {
+            __m128i value   = _mm_loadu_si128((const __m128i *)(stripe + 16 * j));
+            __m128i keyed   = _mm_xor_si128(value, _mm_loadu_si128((const __m128i *)(secret + s + 2 * j)));
+            __m128i high    = _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1));
+            __m128i product = _mm_mul_epu32(keyed, high);                            // low 32 * high 32 per lane
+            __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));    // lanes[i ^ 1] += value
+            acc[j] = _mm_add_epi64(acc[j], _mm_add_epi64(product, swapped));
+        }
+    }
+
+    for (s32 j = 0; j < 4; ++j) { _mm_storeu_si128((__m128i *)(lanes + 2 * j), acc[j]); }
+}
+#endif
+
+#if HASH_AVX2
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+inline void hash_accumulate_avx2(u64 *lanes, const u8 *data, u64 stripes, const u64 *secret) {
+    __m256i acc[2];
+    for (s32 j = 0; j < 2; ++j) { acc[j] = _mm256_loadu_si256((const __m256i *)(lanes + 4 * j)); }
+
+    for (u64 s = 0; s < stripes; ++s) {
+        const u8 *stripe = data + s * HASH_64_STRIPE;
+        for (s32 j = 0; j < 2; ++j) {
+            __m256i value   = _mm256_loadu_si256((const __m256i *)(stripe + 32 * j));
+            __m256i keyed   = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i *)(secret + s + 4 * j)));
+            __m256i high    = _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1));
+            __m256i product = _mm256_mul_epu32(keyed, high);
+            __m256i swapped = _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+            acc[j] = _mm256_add_epi64(acc[j], _mm256_add_epi64(product, swapped));
+        }
+    }
+
+    for (s32 j = 0; j < 2; ++j) { _mm256_storeu_si256((__m256i *)(lanes + 4 * j), acc[j]); }
+}
+
+inline bool hash_cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool os_saves_ymm = (info[2] & (1 << 27)) && ((_xgetbv(0) & 6) == 6); // OSXSAVE, and the OS saves XMM and YMM.
+    if (!os_saves_ymm) { return false; }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+inline Hash_Accumulate_Proc hash_pick_accumulate() {
+#if HASH_AVX2
+    if (hash_cpu_has_avx2()) { return hash_accumulate_avx2; }
+#endif
+#if HASH_SSE2
+    return hash_accumulate_sse2;
+#else
+    return hash_accumulate_scalar;
+#endif
+}
+
+inline void hash_accumulate(u64 *lanes, const u8 *data, u64 stripes, const u64 *secret) {
+    static const Hash_Accumulate_Proc accumulate = hash_pick_accumulate();
+    accumulate(lanes, data, stripes, secret);
+}
+
+// Once per block, so the lanes don't just keep summing.
+inline void hash_scramble(u64 *lanes) {
+    for (s32 i = 0; i < 8; ++i) {
+        u64 lane = lanes[i];
+        lane ^= lane >> 47;
+        lane ^= HASH_64_SECRET[16 + i];
+        lanes[i] = lane * HASH_64_PRIME32;
+    }
+}
+
+inline void hash_lanes_init(u64 *lanes, u64 seed) {
+    const u64 initial[8] = { HASH_64_PRIME32, HASH_64_PRIME_1, HASH_64_PRIME_2, HASH_64_PRIME_3,
+                             HASH_64_PRIME_4, HASH_64_PRIME_5, HASH_64_PRIME_1 ^ HASH_64_PRIME_5, HASH_64_PRIME_2 ^ HASH_64_PRIME_4 };
+    for (s32 i = 0; i < 8; ++i) { lanes[i] = (i & 1) ? initial[i] - seed : initial[i] + seed; }
+}
+
+// The final (possibly partial) block: its whole stripes, then the last 64 bytes of the input, then the lanes are
+// folded into one value. last_stripe may overlap stripes that were already added.
+inline u64 hash_lanes_finish(u64 *lanes, const u8 *data, u64 remaining, const u8 *last_stripe, u64 length) {
+    hash_accumulate(lanes, data, (remaining - 1) / HASH_64_STRIPE, HASH_64_SECRET);
+    hash_accumulate(lanes, last_stripe, 1, HASH_64_SECRET + 9);
+
+    u64 result = length * HASH_64_PRIME_1;
+    for (s32 i = 0; i < 4; ++i) {
+        result += hash_multiply_fold(lanes[2 * i] ^ HASH_64_SECRET[3 + 2 * i], lanes[2 * i + 1] ^ HASH_64_SECRET[4 + 2 * i]);
+    }
+    return hash_avalanche(result);
+}
+
+inline u64 hash_64_long(const u8 *p, u64 length, u64 seed) {
+    u64 lanes[8];
+    hash_lanes_init(lanes, seed);
+
+    // The block holding the last byte is always handled as the final one, even when it is full.
+    u64 blocks = (length - 1) / HASH_64_BLOCK;
+    for (u64 b = 0; b < blocks; ++b) {
+        hash_accumulate(lanes, p + b * HASH_64_BLOCK, HASH_64_STRIPES_PER_BLOCK, HASH_64_SECRET);
+        hash_scramble(lanes);
+    }
+
+    u64 done = blocks * HASH_64_BLOCK;
+    return hash_lanes_finish(lanes, p + done, length - done, p + length - HASH_64_STRIPE, length);
+}
+
+//
+// Interface
+//
+inline u64 hash_64(const void *data, u64 length, u64 seed=0) {
+    const u8 *p = (const u8 *)data;
+    if (length <= 16)              { return hash_64_short(p, length, seed); }
+    if (length <= HASH_64_MID_MAX) { return hash_64_mid(p, length, seed); }
+    return hash_64_long(p, length, seed);
+}
+
+inline void hash_64_init(Hash_64_State *state, u64 seed=0) {
+    hash_lanes_init(state->lanes, seed);
+    state->seed     = seed;
+    state->length   = 0;
+    state->buffered = 0;
+}
+
+inline void hash_64_update(Hash_64_State *state, const void *data, u64 length) {
+    const u8 *p = (const u8 *)data;
+    state->length += length;
+
+    // A block is only consumed once more input shows up after it, the last block goes through hash_lanes_finish.
+    if (state->buffered + length <= HASH_64_BLOCK) {
+        memcpy(state->buffer + state->buffered, p, length);
+        state->buffered += length;
+        return;
+    }
+
+    if (state->buffered) {
+        u64 fill = HASH_64_BLOCK - state->buffered;
+        memcpy(state->buffer + state->buffered, p, fill);
+        p      += fill;
+        length -= fill;
+        hash_accumulate(state->lanes, state->buffer, HASH_64_STRIPES_PER_BLOCK, HASH_64_SECRET);
+        hash_scramble(state->lanes);
+        state->buffered = 0;
+    }
+
+    // Whole blocks straight from the input, no copy.
+    if (length > HASH_64_BLOCK) {
+        while (length > HASH_64_BLOCK) {
+            hash_accumulate(state->lanes, p, HASH_64_STRIPES_PER_BLOCK, HASH_64_SECRET);
+            hash_scramble(state->lanes);
+            p      += HASH_64_BLOCK;
+            length -= HASH_64_BLOCK;
+        }
+        memcpy(state->buffer + HASH_64_BLOCK - HASH_64_STRIPE, p - HASH_64_STRIPE, HASH_64_STRIPE);
+    }
+
+    memcpy(state->buffer, p, length);
+    state->buffered = length;
+}
+
+// Doesn't change the state, more input can still be added after this.
+inline u64 hash_64_final(Hash_64_State *state) {
+    if (state->length <= HASH_64_MID_MAX) { return hash_64(state->buffer, state->length, state->seed); }
+
+    u64 lanes[8];
+    memcpy(lanes, state->lanes, sizeof(lanes));
+
+    // With fewer than 64 bytes buffered the last stripe starts in the previous block, whose tail is still at the
+    // end of the buffer.
+    u8 last_stripe[HASH_64_STRIPE];
+    if (state->buffered >= HASH_64_STRIPE) {
+        memcpy(last_stripe, state->buffer + state->buffered - HASH_64_STRIPE, HASH_64_STRIPE);
+    } else {
+        u64 from_previous = HASH_64_STRIPE - state->buffered;
+        memcpy(last_stripe, state->buffer + HASH_64_BLOCK - from_previous, from_previous);
+        memcpy(last_stripe + from_previous, state->buffer, state->buffered);
+    }
+
+    return hash_lanes_finish(lanes, state->buffer, state->buffered, last_stripe, state->length);
+}
@@ -2,20 +2,51 @@
 
 #include "Types.h"
 #include "Hash.h"
+#include "Allocator.h"
 
 #include <assert.h>
 #include <string.h> // memset
-#include <stdlib.h> // calloc
+#include <type_traits>
+
+// Old slots moved per call during an incremental resize, at least. A step always finishes the cluster it is in.
+#ifndef TABLE_MIGRATE_SLOTS
+#define TABLE_MIGRATE_SLOTS 64
+#endif
+
+// Heap entry arrays this big are mapped straight from the OS. The pages come zeroed and only get touched as
+// entries land in them, so starting a big resize doesn't memset the whole new table.
+#ifndef TABLE_PAGES_THRESHOLD
+#define TABLE_PAGES_THRESHOLD (4ull << 20)
+#endif
+
+// Keys table_find_batch hashes and prefetches before it probes any of them.
+#ifndef TABLE_BATCH_SIZE
+#define TABLE_BATCH_SIZE 32
+#endif
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h> // _mm_prefetch
+#endif
 
 /**
 
    The structure of Hash_States was primarily inspired by nothings's std_ds.h hash table.
 
-   This is a Hash_Table implemention using Linear Probing. If you don't provide a hash function, the default
-   one used is murmur32 hash function and the default table size is 32 slots.
+   This is a Hash_Table implemention using Linear Probing. The default table size is 32 slots.
+
+   Removing uses backward shift deletion: the entries after the removed one in its cluster slide back into the
+   hole when that brings them closer to their home slot, so there are no tombstones and probe chains are exactly
+   as long as they would be if the removed key had never been added. DELETED is no longer written, it stays in
+   HASH_STATE so the values don't change.
+
+   Growing normally rehashes everything at once. After table_incremental_resize(table, true) it instead starts a
+   table twice the size and moves at least TABLE_MIGRATE_SLOTS old slots over on every add, find and remove until
+   the old table is empty, so no single call pays for the whole rehash. Until then a lookup may have to check both
+   tables. The old table is migrated one whole cluster at a time starting at an empty slot, so the clusters that
+   are still in it are untouched and its probes stay correct.
 
-   We use a canonical DELETED sentinel for removed hashes. The other hash states are implemented similar to how
-   stb_ds hash hash uses them.
+   Both of these move entries, so a pointer from table_find_pointer is only good until the next add or remove, or
+   until the next call of any kind while an incremental resize is running.
 
    We pack each entry into an 'Entry' struct for cache reasons so we will have at most 1 cache miss as there is
    a low probability that we will have a collision and therefore will not need to probe outside the cache line.
@@ -23,6 +54,37 @@
    Alternatively, using a linked-list for collisions results in multiple cache misses as for each link is a memory access to some random
    region in memory.
 
+   The hash and the comparator are template parameters so the compiler can inline them into the probe loops.
+   Default_Hash picks the hash from the key type at compile time: integers, enums and pointers go through
+   hash_mix_32 or hash_mix_64, anything else is hashed byte by byte with hash_64. Give your own functor for keys
+   that need more than that:
+
+       struct Point_Hash { u32 operator()(const Point &p) const { return hash_mix_32(p.x * 31 + p.y); } };
+       Hash_Table <Point, s32, Point_Hash> table;
+
+   Function pointers passed to table_init still work and win over the functors, at the cost of a call per key.
+
+   string and const char * keys are hashed and compared by their characters. The table copies each key's
+   characters into its own arena when the key is added, so a table of 100k strings makes a handful of block
+   allocations instead of 100k, and nothing depends on the string they came from staying alive. A removed key's
+   characters stay in the arena until a remove finds more of it dead than alive and copies the live keys into a
+   new one, so removed keys never take more than the live ones plus a byte per slot. The stored characters of a
+   key can move on any remove. table_compact_keys does the same on demand. A string keyed table can be looked up
+   with a plain const char *, no string gets built:
+
+       Hash_Table <string, s32> table;
+       table_init(&table);
+       table_set(&table, string("apple"), 1);
+       s32 *apple = table_find_pointer(&table, "apple");
+
+   Hashers that can take more than Key_Type say so with an is_transparent typedef, the same as the std
+   containers.
+
+   For many independent lookups into a table bigger than the cache, table_find_batch hashes a batch of keys and
+   prefetches their slots before probing any of them, so the cache misses overlap. Once the table no longer fits
+   that measured 1.2 to 1.4 times the lookups per second of calling table_find_pointer in a loop, and no gain
+   while it does fit. benchmarks/bench_table_find_batch.cpp measures it on your machine.
+
 **/
 
 enum HASH_STATE : u8 {
@@ -31,6 +93,19 @@ enum HASH_STATE : u8 {
     VALID   = 2,
 };
 
+// Key parameters of the table_* calls have this type so Key_Type comes only from the table. Otherwise a key
+// argument of a different type, a "literal" for a const char * table or 5 for a u64 one, conflicts with it.
+template <typename T>
+struct Table_Identity { typedef T Type; };
+
+template <typename T>
+using Table_Key_Argument = typename Table_Identity<T>::Type;
+
+// Enables the heterogeneous table_* overloads: the hasher says is_transparent and the lookup isn't already a
+// Key_Type (a "literal" on a const char * table), which the plain overloads take.
+template <typename Hasher, typename Key_Type, typename Lookup>
+using Table_Transparent = typename std::enable_if<!std::is_same<typename std::decay<const Lookup>::type, Key_Type>::value, typename Hasher::is_transparent>::type;
+
 inline u32 next_power_of_two(u32 x) {
     assert(x != 0);
     int p = 1;
@@ -39,8 +114,174 @@ inline u32 next_power_of_two(u32 x) {
     return p;
 }
 
-template <typename Key_Type, typename Value_Type>
+// Keys that are one number: mixed in registers, no loop over bytes.
+template <typename Key_Type, typename Enable = void>
+struct Default_Hash {
+    u32 operator()(const Key_Type &key) const {
+        return (u32)hash_64((const void *)&key, sizeof(key));
+    }
+};
+
+template <typename Key_Type>
+struct Default_Hash <Key_Type, typename std::enable_if<std::is_integral<Key_Type>::value || std::is_enum<Key_Type>::value || std::is_pointer<Key_Type>::value>::type> {
+    u32 operator()(const Key_Type &key) const {
+        if (sizeof(Key_Type) <= 4) { return hash_mix_32((u32)(u64)key); }
+        u64 hash = hash_mix_64((u64)key);
+        return (u32)(hash ^ (hash >> 32));
+    }
+};
+
+template <typename Key_Type>
+struct Default_Equal {
+    bool operator()(const Key_Type &a, const Key_Type &b) const { return a == b; }
+};
+
+inline u32 table_hash_bytes(const void *data, u64 length) {
+    u64 hash = hash_64(data, length);
+    return (u32)(hash ^ (hash >> 32));
+}
+
+// string is only declared here, String.h is left to the code that has strings. Everything below that looks
+// inside one is a template on String, so it is compiled where it is used, with String.h included there.
+struct string;
+
+template <typename String>
+using Table_String = typename std::enable_if<std::is_same<String, string>::value>::type;
+
+// string and const char * hash the same way, so either can look up the other.
+template <>
+struct Default_Hash <string> {
+    typedef void is_transparent;
+
+    template <typename String, typename = Table_String<String>>
+    u32 operator()(const String &key) const  { return table_hash_bytes(key.data, (u64)key.count); }
+    u32 operator()(const char *key) const    { return table_hash_bytes(key, key ? strlen(key) : 0); }
+};
+
+template <>
+struct Default_Hash <const char *> {
+    typedef void is_transparent;
+
+    u32 operator()(const char *key) const    { return table_hash_bytes(key, key ? strlen(key) : 0); }
+    template <typename String, typename = Table_String<String>>
+    u32 operator()(const String &key) const  { return table_hash_bytes(key.data, (u64)key.count); }
+};
+
+template <>
+struct Default_Equal <string> {
+    template <typename String, typename = Table_String<String>>
+    bool operator()(const String &a, const String &b) const {
+        return a.count == b.count && (a.count == 0 || memcmp(a.data, b.data, a.count) == 0);
+    }
+
+    template <typename String, typename = Table_String<String>>
+    bool operator()(const String &a, const char *b) const {
+        u64 length = b ? strlen(b) : 0;
+        return (u64)a.count == length && (length == 0 || memcmp(a.data, b, length) == 0);
+    }
+};
+
+template <>
+struct Default_Equal <const char *> {
+    bool operator()(const char *a, const char *b) const {
+        if (!a || !b) { return a == b; }
+        return strcmp(a, b) == 0;
+    }
+
+    template <typename String, typename = Table_String<String>>
+    bool operator()(const char *a, const String &b) const {
+        return Default_Equal<String>()(b, a);
+    }
+};
+
+// How a key gets into its entry. Plain copy by default, string and const char * keys get their characters
+// copied into the table's arena. store returns the bytes it took from the arena and size gives the same for a
+// stored key, so a table can tell how much of its arena belongs to removed keys. key may be *slot itself, which
+// moves its characters into arena. copy is store into size(key) bytes the caller already has.
+//
+// make turns a heterogeneous lookup into a Key_Type, for tables whose function pointer overrides only take Key_Type.
+template <typename Key_Type>
+struct Table_Key_Storage {
+    static u64  store(Key_Type *slot, const Key_Type &key, Arena *arena)      { *slot = key; return 0; }
+    static void copy(Key_Type *slot, const Key_Type &key, char *characters)   { *slot = key; }
+    static u64  size(const Key_Type &key)                                     { return 0; }
+
+    template <typename Lookup>
+    static Key_Type make(const Lookup &key) { return Key_Type(key); }
+};
+
+template <>
+struct Table_Key_Storage <string> {
+    template <typename String, typename = Table_String<String>>
+    static u64 store(String *slot, const String &key, Arena *arena) {
+        u64 bytes = (u64)key.count + 1;
+        copy(slot, key, (char *)arena_allocate(&arena->allocator, bytes));
+        return bytes;
+    }
+
+    template <typename String, typename = Table_String<String>>
+    static void copy(String *slot, const String &key, char *characters) {
+        s32 count = key.count;
+        if (count) { memcpy(characters, key.data, count); }
+        characters[count] = '\0';
+
+        // Whoever gave the characters owns them, the string just points at them.
+        slot->data      = (u8 *)characters;
+        slot->allocator = NULL;
+        slot->count     = count;
+        slot->capacity  = 0;
+        slot->allocated = false;
+    }
+
+    template <typename String, typename = Table_String<String>>
+    static u64 size(const String &key) { return (u64)key.count + 1; }
+
+    // Both only point at the characters, like make_literal.
+    template <typename String, typename = Table_String<String>>
+    static String make(const String &key) {
+        String result;
+        result.data  = key.data;
+        result.count = key.count;
+        return result;
+    }
+
+    template <typename String = string>
+    static String make(const char *key) {
+        String result;
+        result.data  = (u8 *)key;
+        result.count = key ? (s32)strlen(key) : 0;
+        return result;
+    }
+};
+
+template <>
+struct Table_Key_Storage <const char *> {
+    static u64 store(const char **slot, const char *const &key, Arena *arena) {
+        if (!key) { *slot = NULL; return 0; }
+        u64   length     = strlen(key);
+        char *characters = (char *)arena_allocate(&arena->allocator, length + 1);
+        memcpy(characters, key, length + 1);
+        *slot = characters;
+        return length + 1;
+    }
+
+    static void copy(const char **slot, const char *const &key, char *characters) {
+        if (!key) { *slot = NULL; return; }
+        strcpy(characters, key);
+        *slot = characters;
+    }
+
+    static u64 size(const char *key) { return key ? strlen(key) + 1 : 0; }
+
+    static const char *make(const char *key)   { return key; }
+    template <typename String, typename = Table_String<String>>
+    static const char *make(const String &key) { return (const char *)key.data; }
+};
+
+template <typename Key_Type, typename Value_Type, typename Hasher = Default_Hash<Key_Type>, typename Equal = Default_Equal<Key_Type>>
 struct Hash_Table {
+    typedef bool (*Comparator_Function)(Key_Type, Key_Type);
+
     s32 table_size; // The total size of the table. This should be a power of 2 for quick cache accesses.
     s32 items;      // The number of VALID items in the table.
     s32 resize_threshold;
@@ -56,154 +297,423 @@ struct Hash_Table {
 
     Entry *entries;
 
+    Hasher hasher;
+    Equal  equal;
+
+    // Optional overrides for hasher and equal, NULL unless given to table_init.
     u32  (*hash_function)(void *, s32);               // void pointer to data and length.
-    bool (*comparator_function)(Key_Type, Key_Type);  // comparator function for comparing keys.
+    Comparator_Function comparator_function;          // comparator function for comparing keys.
+
+    Allocator *allocator; // Where entries come from, NULL is the heap. See Allocator.h.
+    Arena      interned;  // Characters of string keys, see Table_Key_Storage.
+    u64        interned_live; // Bytes of interned that belong to keys still in the table.
+    u64        interned_dead; // Bytes left behind by removed keys, until table_compact_keys.
+
+    // Incremental resize. old_entries is only set while entries are being moved from there into entries.
+    bool   incremental;
+    Entry *old_entries;
+    s32    old_size;
+    s32    old_items;     // Entries still in old_entries, the rest of items are in entries.
+    s32    migrate_start; // First old slot to move, an empty one so no cluster gets split.
+    s32    migrate_done;  // Old slots moved so far, counting on from migrate_start.
 };
 
 
 template <typename Key_Type>
-bool default_comparator_function(Key_Type a, Key_Type b) { 
+bool default_comparator_function(Key_Type a, Key_Type b) {
     return a == b;
 }
 
+//
+// Internal functions
+//
 
-template <typename Key_Type, typename Value_Type>
-inline void table_init(Hash_Table <Key_Type, Value_Type> *table, s64 _table_size=0, bool (*given_comparator)(Key_Type, Key_Type )=NULL, u32 (*given_hash_function)(void *, s32)=NULL) {
-    if (!given_hash_function) {
-        table->hash_function = murmur_32;
-    } else {
-        table->hash_function = given_hash_function;
-    }
+// Never one of the HASH_STATE values.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline u32 table_hash(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Key_Type &key) {
+    u32 hash = table->hash_function ? table->hash_function((void *)&key, sizeof(key)) : table->hasher(key);
+    if (hash < HASH_STATE::VALID) { hash += HASH_STATE::VALID; }
+    return hash;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup>
+inline u32 table_hash_lookup(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup &key) {
+    u32 hash = table->hasher(key);
+    if (hash < HASH_STATE::VALID) { hash += HASH_STATE::VALID; }
+    return hash;
+}
 
-    if (!given_comparator) {
-        table->comparator_function = default_comparator_function;
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline bool table_keys_equal(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Key_Type &a, const Key_Type &b) {
+    return table->comparator_function ? table->comparator_function(a, b) : table->equal(a, b);
+}
+
+inline bool table_uses_pages(Allocator *allocator, u64 bytes) {
+    return !allocator && bytes >= TABLE_PAGES_THRESHOLD;
+}
+
+template <typename Entry>
+inline void table_free_entries(Allocator *allocator, Entry *entries, s32 table_size) {
+    u64 bytes = (u64)table_size*sizeof(Entry);
+    if (table_uses_pages(allocator, bytes)) {
+        page_deallocate(entries, bytes);
     } else {
-        table->comparator_function = given_comparator;
+        allocator_deallocate(allocator, entries, bytes);
     }
+}
 
+// Allocates a fresh, empty entries array. items is left alone, the caller moves the old entries over.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_allocate_entries(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, s64 _table_size) {
     if (_table_size == 0) { _table_size = table->MIN_SIZE; }
 
     u32 aligned_table_size = next_power_of_two(_table_size);
 
     table->table_size = aligned_table_size;
-    table->items      = 0;
 
-    table->entries = (typename Hash_Table <Key_Type, Value_Type>::Entry *) calloc(table->table_size, sizeof(typename Hash_Table <Key_Type, Value_Type>::Entry));
-
-    memset(table->entries, 0, table->table_size*sizeof(typename Hash_Table <Key_Type, Value_Type>::Entry));
+    u64 bytes = (u64)table->table_size*sizeof(typename Hash_Table <Key_Type, Value_Type, Hasher, Equal>::Entry);
+    if (table_uses_pages(table->allocator, bytes)) {
+        table->entries = (typename Hash_Table <Key_Type, Value_Type, Hasher, Equal>::Entry *) page_allocate(bytes);
+    } else {
+        table->entries = (typename Hash_Table <Key_Type, Value_Type, Hasher, Equal>::Entry *) allocator_allocate(table->allocator, bytes);
+        memset((void *)table->entries, 0, bytes);
+    }
+    assert(table->entries);
 
     table->resize_threshold = (table->table_size * table->LOAD_FACTOR_PERCENT) / 100;
 }
 
-template <typename Key_Type, typename Value_Type>
-inline void table_deinit(Hash_Table <Key_Type, Value_Type> *table) {
-    free(table->entries);
+// Linear probe for key in one entries array. Lookup is Key_Type or anything else compare takes.
+template <typename Entry, typename Lookup, typename Compare>
+inline Entry *table_probe(Entry *entries, s32 table_size, u32 hash, const Lookup &key, Compare &&compare) {
+    u32 mask  = (u32)table_size - 1;
+    u32 index = hash & mask;
+
+    while (entries[index].hash) {
+        auto *entry = &entries[index];
+        // The hash is compared first, most mismatches never look at the key.
+        if (entry->hash == hash && compare(entry->key, key)) {
+            return entry;
+        }
+        index = (index + 1) & mask;
+    }
+
+    return NULL;
+}
+
+template <typename Entry>
+inline Entry *table_vacant_entry(Entry *entries, s32 table_size, u32 hash) {
+    u32 mask  = (u32)table_size - 1;
+    u32 index = hash & mask;
+    while (entries[index].hash) { index = (index + 1) & mask; }
+    return &entries[index];
+}
+
+// Backward shift deletion. Walks the rest of the cluster and moves each entry into the hole if the hole is
+// between its home slot and where it is now, then the last hole becomes VACANT.
+template <typename Entry>
+inline void table_erase(Entry *entries, s32 table_size, Entry *entry) {
+    u32 mask = (u32)table_size - 1;
+    u32 hole = (u32)(entry - entries);
+    u32 next = (hole + 1) & mask;
+
+    while (entries[next].hash) {
+        u32 home = entries[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            memcpy((void *)&entries[hole], (void *)&entries[next], sizeof(Entry));
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+
+    entries[hole].hash = HASH_STATE::VACANT;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline bool table_migrating(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table) {
+    return table->old_entries != NULL;
+}
+
+// Moves at least slots old slots into entries, then on to the end of the cluster. Less than 0 moves everything.
+// Entries are moved as they are: the stored hash says where they go and interned keys keep pointing into the
+// arena.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void table_migrate(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, s32 slots) {
+    if (!table_migrating(table)) { return; }
+
+    auto *old  = table->old_entries;
+    u32   mask = (u32)table->old_size - 1;
+
+    while (table->migrate_done < table->old_size) {
+        auto *entry = &old[(table->migrate_start + table->migrate_done) & mask];
+        if (entry->hash) {
+            memcpy((void *)table_vacant_entry(table->entries, table->table_size, entry->hash), (void *)entry, sizeof(*entry));
+            entry->hash = HASH_STATE::VACANT;
+            table->old_items--;
+        }
+        table->migrate_done++;
+
+        // Only stop where the next old slot is empty, between two clusters.
+        if (--slots == 0) {
+            if (table->migrate_done == table->old_size) { break; }
+            if (old[(table->migrate_start + table->migrate_done) & mask].hash == HASH_STATE::VACANT) { break; }
+            slots = 1;
+        }
+    }
+
+    if (table->migrate_done == table->old_size) {
+        table_free_entries(table->allocator, old, table->old_size);
+        table->old_entries = NULL;
+        table->old_size    = 0;
+        table->old_items   = 0;
+    }
 }
 
-template <typename Key_Type, typename Value_Type>
-inline void table_expand(Hash_Table <Key_Type, Value_Type> *table) {
-    auto *old_entries = table->entries;
-    s32   old_size    = table->table_size;
+// Starts moving everything into a table twice the size.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void table_begin_resize(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table) {
+    table_migrate(table, -1); // Finish the last one first.
+
+    table->old_entries = table->entries;
+    table->old_size    = table->table_size;
+    table->old_items   = table->items;
+    table->migrate_done = 0;
+
+    // Start at an empty slot, there always is one below the load factor.
+    table->migrate_start = 0;
+    while (table->old_entries[table->migrate_start].hash) { table->migrate_start++; }
 
     s32 new_table_size = table->table_size * 2;
     if (new_table_size < table->MIN_SIZE) {
         new_table_size = table->MIN_SIZE;
     }
 
-    table_init(table, new_table_size);
+    // Same hash, comparator, allocator and key arena as before.
+    table_allocate_entries(table, new_table_size);
+}
 
-    for (s32 i = 0; i < old_size; ++i) {
-        auto *entry = &old_entries[i];
-        if (entry->hash >= HASH_STATE::VALID) {
-            table_add(table, entry->key, entry->value);
-        }
-    }
+inline void table_prefetch(const void *address) {
+#if defined(_MSC_VER)
+    _mm_prefetch((const char *)address, _MM_HINT_T0);
+#else
+    __builtin_prefetch(address, 0, 3);
+#endif
+}
 
-    free(old_entries);
+// Finds key in the table being filled and in the one being emptied.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename Compare>
+inline typename Hash_Table <Key_Type, Value_Type, Hasher, Equal>::Entry *table_find_entry(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, u32 hash, const Lookup &key, Compare &&compare) {
+    auto *entry = table_probe(table->entries, table->table_size, hash, key, compare);
+    if (!entry && table_migrating(table)) {
+        entry = table_probe(table->old_entries, table->old_size, hash, key, compare);
+    }
+    return entry;
 }
 
-template <typename Key_Type, typename Value_Type>
-inline bool table_remove(Hash_Table <Key_Type, Value_Type> *table, Key_Type key) {
-    u32 hash = table->hash_function((void *)&key, sizeof(key));
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_erase_entry(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, typename Hash_Table <Key_Type, Value_Type, Hasher, Equal>::Entry *entry) {
+    u64 bytes = Table_Key_Storage<Key_Type>::size(entry->key);
+    table->interned_live -= bytes;
+    table->interned_dead += bytes;
 
-    if (hash < HASH_STATE::VALID) { hash += HASH_STATE::VALID; }
+    if (entry >= table->entries && entry < table->entries + table->table_size) {
+        table_erase(table->entries, table->table_size, entry);
+    } else {
+        table_erase(table->old_entries, table->old_size, entry);
+        table->old_items--;
+    }
+    --table->items;
 
-    u32 index = hash & (table->table_size - 1);
+    // Once the dead characters outweigh the live ones and the slots to walk, compacting costs no more than the
+    // removes that led up to it. Never true for keys that aren't interned.
+    if (table->interned_dead > table->interned_live + (u64)table->table_size + (u64)table->old_size) {
+        table_compact_keys(table);
+    }
+}
 
-    while (table->entries[index].hash) {
-        auto *entry = &table->entries[index];
-        if (entry->hash == hash && table->comparator_function(entry->key, key)) {
-            entry->hash = HASH_STATE::DELETED;
-            --table->items;
-            return true;
-        }
+//
+// Interface
+//
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_init(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, s64 _table_size=0, typename Hash_Table <Key_Type, Value_Type, Hasher, Equal>::Comparator_Function given_comparator=NULL, u32 (*given_hash_function)(void *, s32)=NULL, Allocator *allocator=NULL) {
+    table->hash_function       = given_hash_function;
+    table->comparator_function = given_comparator;
+    table->allocator           = allocator;
+    table->items               = 0;
+
+    table->incremental   = false;
+    table->old_entries   = NULL;
+    table->old_size      = 0;
+    table->old_items     = 0;
+    table->migrate_start = 0;
+    table->migrate_done  = 0;
+
+    arena_init(&table->interned);
+    table->interned_live = 0;
+    table->interned_dead = 0;
+    table_allocate_entries(table, _table_size);
+}
 
-        index += 1;
-        if (index >= table->table_size) { index = 0; }
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_deinit(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table) {
+    table_free_entries(table->allocator, table->entries, table->table_size);
+    table->entries = NULL;
+    if (table_migrating(table)) {
+        table_free_entries(table->allocator, table->old_entries, table->old_size);
+        table->old_entries = NULL;
     }
+    arena_deinit(&table->interned);
+}
+
+// Grow in small steps spread over later calls instead of all at once. For tables where a rehash pause would show
+// up in the latency.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_incremental_resize(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, bool incremental) {
+    table->incremental = incremental;
+    if (!incremental) { table_migrate(table, -1); }
+}
 
-    return false;
+// Doubles the table in one go.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_expand(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table) {
+    table_begin_resize(table);
+    table_migrate(table, -1);
 }
 
-template <typename Key_Type, typename Value_Type>
-inline void table_add(Hash_Table <Key_Type, Value_Type> *table, Key_Type key, Value_Type value) {
-    if (table->items >= table->resize_threshold) { table_expand(table); }
+// Copies the characters of every key still in the table into a fresh arena and frees the old one, along with
+// everything removed keys left in it.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void table_compact_keys(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table) {
+    Arena compacted;
+    arena_init(&compacted, table->interned.block_size);
 
-    assert(table->items <= table->table_size);
+    for (s32 i = 0; i < table->table_size; ++i) {
+        if (table->entries[i].hash) { Table_Key_Storage<Key_Type>::store(&table->entries[i].key, table->entries[i].key, &compacted); }
+    }
+    for (s32 i = 0; i < table->old_size; ++i) {
+        if (table->old_entries[i].hash) { Table_Key_Storage<Key_Type>::store(&table->old_entries[i].key, table->old_entries[i].key, &compacted); }
+    }
 
-    u32 hash = table->hash_function((void *)&key, sizeof(key));
+    arena_deinit(&table->interned);
+    table->interned      = compacted;
+    table->interned_dead = 0;
+}
 
-    if (hash < HASH_STATE::VALID) { hash += HASH_STATE::VALID; }
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline bool table_remove(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key) {
+    table_migrate(table, TABLE_MIGRATE_SLOTS);
 
-    u32 index = hash & (table->table_size - 1);
+    auto *entry = table_find_entry(table, table_hash(table, key), key, [table](const Key_Type &a, const Key_Type &b) { return table_keys_equal(table, a, b); });
+    if (!entry) { return false; }
 
-    while (1) { // We should always have an empty slot.
-        auto *entry = &table->entries[index];
-        if (entry->hash == HASH_STATE::VACANT) {
-            entry->hash  = hash;
-            entry->key   = key;
-            entry->value = value;
-            table->items++;
-            return;
-        }
+    table_erase_entry(table, entry);
+    return true;
+}
 
-        index += 1;
-        if (index >= table->table_size) { index = 0; }
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_add(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key, Value_Type value) {
+    table_migrate(table, TABLE_MIGRATE_SLOTS);
+
+    // Only what is already in the new entries counts towards its load.
+    if (table->items - table->old_items >= table->resize_threshold) {
+        if (table->incremental) {
+            table_begin_resize(table);
+            table_migrate(table, TABLE_MIGRATE_SLOTS);
+        } else {
+            table_expand(table);
+        }
     }
+
+    assert(table->items <= table->table_size + table->old_size);
+
+    u32 hash = table_hash(table, key);
+
+    // New keys always go in the new entries.
+    auto *entry  = table_vacant_entry(table->entries, table->table_size, hash);
+    entry->hash  = hash;
+    table->interned_live += Table_Key_Storage<Key_Type>::store(&entry->key, key, &table->interned);
+    entry->value = value;
+    table->items++;
 }
 
-template <typename Key_Type, typename Value_Type>
-inline Value_Type *table_find_pointer(Hash_Table <Key_Type, Value_Type> *table, Key_Type key) {
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline Value_Type *table_find_pointer(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key) {
     if (!table->table_size) { return NULL; }
+    table_migrate(table, TABLE_MIGRATE_SLOTS);
+
+    auto *entry = table_find_entry(table, table_hash(table, key), key, [table](const Key_Type &a, const Key_Type &b) { return table_keys_equal(table, a, b); });
+    return entry ? &entry->value : NULL;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline bool table_find(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key) {
+    Value_Type *value = table_find_pointer(table, key);
+    if (!value) { return false; }
+    return true;
+}
 
-    u32 hash = table->hash_function((void *)&key, sizeof(key));
+// The body of both table_find_batch overloads, hash and compare are the ones for the key type.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename Hash, typename Compare>
+s32 table_find_batch_with(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup *keys, s32 count, Value_Type **values, Hash &&hash, Compare &&compare) {
+    if (!table->table_size) {
+        for (s32 i = 0; i < count; ++i) { values[i] = NULL; }
+        return 0;
+    }
+    table_migrate(table, TABLE_MIGRATE_SLOTS);
 
-    if (hash <= HASH_STATE::VALID) { hash += HASH_STATE::VALID; }
+    u32 mask  = (u32)table->table_size - 1;
+    u32 hashes[TABLE_BATCH_SIZE];
+    s32 found = 0;
 
-    u32 index = hash & (table->table_size - 1);
+    for (s32 start = 0; start < count; start += TABLE_BATCH_SIZE) {
+        s32 batch = (count - start < TABLE_BATCH_SIZE) ? count - start : TABLE_BATCH_SIZE;
 
-    while (table->entries[index].hash) {
-        auto *entry = &table->entries[index];
-        if (entry->hash == hash && table->comparator_function(entry->key, key)) {
-            return &entry->value;
+        for (s32 i = 0; i < batch; ++i) {
+            hashes[i] = hash(keys[start + i]);
+            table_prefetch(&table->entries[hashes[i] & mask]);
+            if (table_migrating(table)) { table_prefetch(&table->old_entries[hashes[i] & ((u32)table->old_size - 1)]); }
         }
 
-        index += 1;
-        if (index >= table->table_size) { index = 0; }
+        for (s32 i = 0; i < batch; ++i) {
+            auto *entry = table_find_entry(table, hashes[i], keys[start + i], compare);
+            values[start + i] = entry ? &entry->value : NULL;
+            found += (entry != NULL);
+        }
     }
+    return found;
+}
 
-    return NULL;
+// table_find_pointer for count keys at once, values[i] is the value of keys[i] or NULL. Returns how many were
+// found. The keys are hashed and their home slots prefetched TABLE_BATCH_SIZE at a time before any of them is
+// probed, so on a table bigger than the cache the misses overlap instead of each lookup waiting out its own.
+// Takes one migration step for the whole batch.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+s32 table_find_batch(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Key_Type *keys, s32 count, Value_Type **values) {
+    return table_find_batch_with(table, keys, count, values,
+                                 [table](const Key_Type &key) { return table_hash(table, key); },
+                                 [table](const Key_Type &a, const Key_Type &b) { return table_keys_equal(table, a, b); });
 }
 
-template <typename Key_Type, typename Value_Type>
-inline bool table_find(Hash_Table <Key_Type, Value_Type> *table, Key_Type key) {
-    Value_Type *value = table_find_pointer(table, key);
-    if (!value) { return false; }
-    return true;
+// The same by any type the hasher takes, see the transparent lookups below.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+s32 table_find_batch(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup *keys, s32 count, Value_Type **values) {
+    // Function pointer overrides only understand Key_Type, so then the keys go one at a time.
+    if (table->hash_function || table->comparator_function) {
+        s32 found = 0;
+        for (s32 i = 0; i < count; ++i) {
+            values[i] = table_find_pointer(table, keys[i]);
+            found += (values[i] != NULL);
+        }
+        return found;
+    }
+
+    return table_find_batch_with(table, keys, count, values,
+                                 [table](const Lookup &key) { return table_hash_lookup(table, key); },
+                                 table->equal);
 }
 
-template <typename Key_Type, typename Value_Type>
-inline void table_set(Hash_Table <Key_Type, Value_Type> *table, Key_Type key, Value_Type new_value) {
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_set(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key, Value_Type new_value) {
     Value_Type *old_value = table_find_pointer(table, key);
     if (old_value) {  // If there exists an old value just point the old value to the new value.
         *old_value = new_value;
@@ -211,3 +721,33 @@ inline void table_set(Hash_Table <Key_Type, Value_Type> *table, Key_Type key, Va
         table_add(table, key, new_value);
     }
 }
+
+// Lookups by any type the hasher takes, when it is marked is_transparent. A string keyed table can be searched
+// with a const char * without building a string.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+inline Value_Type *table_find_pointer(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup &key) {
+    if (!table->table_size) { return NULL; }
+    // Function pointer overrides only understand Key_Type.
+    if (table->hash_function || table->comparator_function) { return table_find_pointer(table, Table_Key_Storage<Key_Type>::make(key)); }
+    table_migrate(table, TABLE_MIGRATE_SLOTS);
+
+    auto *entry = table_find_entry(table, table_hash_lookup(table, key), key, table->equal);
+    return entry ? &entry->value : NULL;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+inline bool table_find(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup &key) {
+    return table_find_pointer(table, key) != NULL;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+inline bool table_remove(Hash_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup &key) {
+    if (table->hash_function || table->comparator_function) { return table_remove(table, Table_Key_Storage<Key_Type>::make(key)); }
+    table_migrate(table, TABLE_MIGRATE_SLOTS);
+
+    auto *entry = table_find_entry(table, table_hash_lookup(table, key), key, table->equal);
+    if (!entry) { return false; }
+
+    table_erase_entry(table, entry);
+    return true;
+}
@@ -0,0 +1,337 @@
+#pragma once
+
+#include "Types.h"
+#include "Allocator.h"
+#include "Hash_Table.h" // Default_Hash, Default_Equal, Table_Key_Storage and next_power_of_two.
+#include "Epoch.h"
+#include "Sync.h"
+
+#include <assert.h>
+#include <atomic>
+#include <string.h>
+
+/**
+
+   A hash map for read mostly data (configuration, routing) where readers never take a lock or write to a shared
+   cache line, so lookups scale with the cores. Writers take a mutex and are slower than Hash_Table's.
+
+   The layout is Hash_Table's linear probing over a power of 2 array, except each slot is an atomic pointer to
+   an immutable node holding the hash, key and value. A writer never changes a node a reader could see: it
+   builds a new one and swaps the slot's pointer, then hands the old node to epoch_retire. Removing swaps in a
+   tombstone. When the slots fill up the writer copies the live pointers into a new array, publishes it, and
+   retires the old array, the nodes themselves are shared and don't move. A string or const char * key's
+   characters are copied to the end of its node, so they are freed with it and nodes vary in size.
+
+       Lock_Free_Hash_Map <u64, Route> routes;
+       table_init(&routes);
+       table_set(&routes, id, route);        // Writers, any thread.
+
+       Route route;
+       if (table_find(&routes, id, &route)) { ... }  // Readers, any thread, no lock.
+
+   table_find copies the value out. table_find_pointer doesn't, the pointer is good until the Epoch_Scope the
+   caller must be holding ends:
+
+       {
+           Epoch_Scope scope(routes.epoch);
+           Route *route = table_find_pointer(&routes, id);
+       }
+
+   A reader sees each key either before or after a write to it, never half of one. A lookup that started before
+   a resize finishes in the old array, so it can miss a write that lands during the lookup, which it could just
+   as well have run before.
+
+   Maps share epoch_global() unless table_init gets an Epoch, so the readers of one map can hold back frees of
+   another. Give busy maps their own.
+
+   A retire into an epoch can free anything retired into it before, from any map using it, on the retiring
+   thread and without the other map's writer lock. So every map on a shared epoch needs an allocator that is
+   safe to free into from any thread, like the heap. A map given an allocator and no epoch gets an epoch of its
+   own, which only its writers retire into. Don't call epoch_reclaim or epoch_synchronize on that one from
+   outside the writer lock, and don't hand an Arena or Pool allocator to a map along with a shared epoch.
+
+**/
+
+template <typename Key_Type, typename Value_Type, typename Hasher = Default_Hash<Key_Type>, typename Equal = Default_Equal<Key_Type>>
+struct Lock_Free_Hash_Map {
+    const int MIN_SIZE            = 32;
+    const int LOAD_FACTOR_PERCENT = 70; // Counting tombstones.
+
+    struct Node {
+        u32        hash;
+        Key_Type   key;
+        Value_Type value;
+    };
+
+    // One block: this header, then table_size slots.
+    struct Slots {
+        s32                  table_size;
+        std::atomic<Node *> *nodes;
+    };
+
+    std::atomic<Slots *> slots;
+
+    std::atomic<s32> items;
+    s32              used; // Items and tombstones, only touched by writers.
+
+    Mutex      writer;    // Held by table_set and table_remove.
+    Epoch     *epoch;
+    bool       owns_epoch; // Made by table_init for a map with its own allocator, see above.
+    Allocator *allocator; // Where nodes and slots come from, NULL is the heap.
+
+    Hasher hasher;
+    Equal  equal;
+};
+
+//
+// Internal functions
+//
+
+// Marks a removed slot. Never dereferenced, only compared against.
+template <typename Node>
+inline Node *lock_free_tombstone() {
+    alignas(Node) static char tombstone[sizeof(Node)];
+    return (Node *)tombstone;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline u64 lock_free_slots_bytes(s32 table_size) {
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Node  Node;
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Slots Slots;
+    return align_forward(sizeof(Slots), ALLOCATOR_ALIGNMENT) + (u64)table_size * sizeof(std::atomic<Node *>);
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Slots *lock_free_allocate_slots(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map, s32 table_size) {
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Node  Node;
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Slots Slots;
+
+    u64 bytes = lock_free_slots_bytes<Key_Type, Value_Type, Hasher, Equal>(table_size);
+    u8 *block = (u8 *)allocator_allocate(map->allocator, bytes);
+    assert(block);
+    memset((void *)block, 0, bytes); // Every slot starts out NULL.
+
+    Slots *slots      = (Slots *)block;
+    slots->table_size = table_size;
+    slots->nodes      = (std::atomic<Node *> *)(block + align_forward(sizeof(Slots), ALLOCATOR_ALIGNMENT));
+    return slots;
+}
+
+// The node holding key, NULL if there is none. Safe for readers inside an epoch section and for writers.
+template <typename Slots, typename Lookup, typename Compare>
+inline auto lock_free_probe(Slots *slots, u32 hash, const Lookup &key, Compare &&compare) -> decltype(slots->nodes[0].load()) {
+    typedef decltype(slots->nodes[0].load()) Node_Pointer;
+    Node_Pointer tombstone = lock_free_tombstone<typename std::remove_pointer<Node_Pointer>::type>();
+
+    u32 mask  = (u32)slots->table_size - 1;
+    u32 index = hash & mask;
+    for (s32 probes = 0; probes < slots->table_size; ++probes) {
+        Node_Pointer node = slots->nodes[index].load(std::memory_order_acquire);
+        if (!node) { return NULL; }
+        if (node != tombstone && node->hash == hash && compare(node->key, key)) { return node; }
+        index = (index + 1) & mask;
+    }
+    return NULL;
+}
+
+// Slot index of key, -1 if it isn't there. Writers only.
+template <typename Slots, typename Lookup, typename Compare>
+inline s32 lock_free_probe_index(Slots *slots, u32 hash, const Lookup &key, Compare &&compare) {
+    auto *node = lock_free_probe(slots, hash, key, compare);
+    if (!node) { return -1; }
+
+    u32 mask  = (u32)slots->table_size - 1;
+    u32 index = hash & mask;
+    while (slots->nodes[index].load(std::memory_order_relaxed) != node) { index = (index + 1) & mask; }
+    return (s32)index;
+}
+
+// Moves every live node into a new array big enough for one more item, then retires the old one. Writers only.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void lock_free_rebuild(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map) {
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Node  Node;
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Slots Slots;
+
+    Slots *old_slots = map->slots.load(std::memory_order_relaxed);
+    s32    items     = map->items.load(std::memory_order_relaxed);
+
+    // Mostly tombstones: same size. Otherwise keep the live items at half the slots at most.
+    s32 table_size = old_slots->table_size;
+    while ((s64)(items + 1) * 2 > table_size) { table_size *= 2; }
+
+    Slots *new_slots = lock_free_allocate_slots(map, table_size);
+    u32    mask      = (u32)table_size - 1;
+    for (s32 i = 0; i < old_slots->table_size; ++i) {
+        Node *node = old_slots->nodes[i].load(std::memory_order_relaxed);
+        if (!node || node == lock_free_tombstone<Node>()) { continue; }
+
+        u32 index = node->hash & mask;
+        while (new_slots->nodes[index].load(std::memory_order_relaxed)) { index = (index + 1) & mask; }
+        new_slots->nodes[index].store(node, std::memory_order_relaxed);
+    }
+
+    map->slots.store(new_slots, std::memory_order_seq_cst);
+    map->used = items;
+    epoch_retire(map->epoch, old_slots, lock_free_slots_bytes<Key_Type, Value_Type, Hasher, Equal>(old_slots->table_size), map->allocator);
+}
+
+// A node is followed by the characters of its key when the key type interns them (see Table_Key_Storage), so they
+// are retired and freed along with it.
+template <typename Node>
+inline u64 lock_free_node_bytes(Node *node) {
+    return sizeof(Node) + Table_Key_Storage<decltype(node->key)>::size(node->key);
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Node *lock_free_allocate_node(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map, const Key_Type &key) {
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Node Node;
+    u64   bytes = sizeof(Node) + Table_Key_Storage<Key_Type>::size(key);
+    Node *node  = (Node *)allocator_allocate(map->allocator, bytes);
+    assert(node);
+    memset((void *)node, 0, sizeof(Node));
+    Table_Key_Storage<Key_Type>::copy(&node->key, key, (char *)(node + 1));
+    return node;
+}
+
+//
+// Interface
+//
+// A NULL epoch is epoch_global(), or a new one for the map alone when allocator isn't NULL.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void table_init(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map, s64 _table_size=0, Epoch *epoch=NULL, Allocator *allocator=NULL) {
+    map->owns_epoch = !epoch && allocator;
+    if (map->owns_epoch) {
+        epoch = new Epoch;
+        epoch_init(epoch);
+    }
+    map->epoch     = epoch ? epoch : epoch_global();
+    map->allocator = allocator;
+    map->items.store(0, std::memory_order_relaxed);
+    map->used = 0;
+    mutex_create(&map->writer);
+
+    if (_table_size < map->MIN_SIZE) { _table_size = map->MIN_SIZE; }
+    map->slots.store(lock_free_allocate_slots(map, (s32)next_power_of_two((u32)_table_size)), std::memory_order_release);
+}
+
+// No thread may be using the map anymore. Nodes already retired are freed by the epoch, here when it is the map's own.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void table_deinit(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map) {
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Node  Node;
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Slots Slots;
+
+    Slots *slots = map->slots.load(std::memory_order_acquire);
+    for (s32 i = 0; i < slots->table_size; ++i) {
+        Node *node = slots->nodes[i].load(std::memory_order_relaxed);
+        if (node && node != lock_free_tombstone<Node>()) { allocator_deallocate(map->allocator, node, lock_free_node_bytes(node)); }
+    }
+    allocator_deallocate(map->allocator, slots, lock_free_slots_bytes<Key_Type, Value_Type, Hasher, Equal>(slots->table_size));
+    map->slots.store(NULL, std::memory_order_relaxed);
+
+    mutex_destroy(&map->writer);
+
+    if (map->owns_epoch) {
+        epoch_deinit(map->epoch);
+        delete map->epoch;
+        map->epoch = NULL;
+    }
+}
+
+// Only valid inside an Epoch_Scope on map->epoch, see above.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline Value_Type *table_find_pointer(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map, const Table_Key_Argument<Key_Type> &key) {
+    auto *node = lock_free_probe(map->slots.load(std::memory_order_acquire), map->hasher(key), key, map->equal);
+    return node ? &node->value : NULL;
+}
+
+// Copies the value into *value when key is there. value can be NULL to only check.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline bool table_find(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map, const Table_Key_Argument<Key_Type> &key, Value_Type *value=NULL) {
+    Epoch_Scope scope(map->epoch);
+    Value_Type *found = table_find_pointer(map, key);
+    if (found && value) { *value = *found; }
+    return found != NULL;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void table_set(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map, const Table_Key_Argument<Key_Type> &key, Value_Type value) {
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Node  Node;
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Slots Slots;
+
+    Scoped_Lock lock(&map->writer);
+
+    u32    hash  = map->hasher(key);
+    Slots *slots = map->slots.load(std::memory_order_relaxed);
+    s32    index = lock_free_probe_index(slots, hash, key, map->equal);
+
+    Node *node = lock_free_allocate_node(map, key);
+    node->hash  = hash;
+    node->value = value;
+
+    if (index >= 0) {
+        Node *old_node = slots->nodes[index].load(std::memory_order_relaxed);
+        slots->nodes[index].store(node, std::memory_order_seq_cst);
+        epoch_retire(map->epoch, old_node, lock_free_node_bytes(old_node), map->allocator);
+        return;
+    }
+
+    if ((s64)(map->used + 1) * 100 > (s64)slots->table_size * map->LOAD_FACTOR_PERCENT) {
+        lock_free_rebuild(map);
+        slots = map->slots.load(std::memory_order_relaxed);
+    }
+
+    // Reusing a tombstone is fine, the key isn't anywhere further along its probe.
+    u32   mask      = (u32)slots->table_size - 1;
+    u32   free_slot = hash & mask;
+    Node *current   = slots->nodes[free_slot].load(std::memory_order_relaxed);
+    while (current && current != lock_free_tombstone<Node>()) {
+        free_slot = (free_slot + 1) & mask;
+        current   = slots->nodes[free_slot].load(std::memory_order_relaxed);
+    }
+    if (!current) { map->used++; }
+
+    slots->nodes[free_slot].store(node, std::memory_order_seq_cst);
+    map->items.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+bool table_remove(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map, const Table_Key_Argument<Key_Type> &key) {
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Node  Node;
+    typedef typename Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal>::Slots Slots;
+
+    Scoped_Lock lock(&map->writer);
+
+    Slots *slots = map->slots.load(std::memory_order_relaxed);
+    s32    index = lock_free_probe_index(slots, map->hasher(key), key, map->equal);
+    if (index < 0) { return false; }
+
+    Node *old_node = slots->nodes[index].exchange(lock_free_tombstone<Node>(), std::memory_order_seq_cst);
+    epoch_retire(map->epoch, old_node, lock_free_node_bytes(old_node), map->allocator);
+    map->items.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline s32 table_items(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map) {
+    return map->items.load(std::memory_order_relaxed);
+}
+
+// Lookups by any type the hasher takes, see Hash_Table.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+inline Value_Type *table_find_pointer(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map, const Lookup &key) {
+    auto *node = lock_free_probe(map->slots.load(std::memory_order_acquire), map->hasher(key), key, map->equal);
+    return node ? &node->value : NULL;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+inline bool table_find(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map, const Lookup &key, Value_Type *value=NULL) {
+    Epoch_Scope scope(map->epoch);
+    Value_Type *found = table_find_pointer(map, key);
+    if (found && value) { *value = *found; }
+    return found != NULL;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+bool table_remove(Lock_Free_Hash_Map <Key_Type, Value_Type, Hasher, Equal> *map, const Lookup &key) {
+    return table_remove(map, Table_Key_Storage<Key_Type>::make(key));
+}
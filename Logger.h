@@ -2,6 +2,7 @@
  
 #include "String.h"
 #include "Array.h"
+#include "Small_Array.h"
 #include "Ascii_Color_Codes.h"
 
 #include <thread> 
@@ -93,7 +94,7 @@ public:
     std::thread       logger_thread;
 
     // All destination sinks where logging with commence.
-    Array <std::ostream *> sinks;
+    Small_Array <std::ostream *, 4> sinks; // Almost always one or two, they stay inline.
 
     // logger_active means that we are in a state of logging.
     std::atomic<bool> logger_active;
@@ -105,7 +106,7 @@ public:
 
     ~Logger() { 
         thread_work_signaled.store(false, std::memory_order_seq_cst);
-        logger_active.store(false, std::memory_order_seq_csdt);
+        logger_active.store(false, std::memory_order_seq_cst);
         logger_condition.notify_one();
 
         for (auto *elem: sinks) { (*elem).flush(); }
@@ -1,63 +1,307 @@
-#pragma once 
+#pragma once
 
-#include "Array.h"
 #include "Types.h"
 
+#include <assert.h>
+#include <stdlib.h> // malloc
+#include <string.h> // memcpy
+#include <new>
+#include <utility>
+#include <type_traits>
+
+/**
+
+   FIFO queue on a power of 2 circular buffer.
+
+   head is the slot of the front element and the live elements run from there for 'size' slots, wrapping
+   around the end of the buffer. Popped slots are reused by later pushes so a queue that is pushed and popped
+   forever holds on to memory for its peak depth and nothing more.
+
+   Growing doubles the buffer and moves only the live elements over, unwrapping them so the new buffer starts
+   at slot 0. queue_shrink_to_fit gives memory back after a burst.
+
+   Slots outside the live range are raw memory: a push constructs in place and a pop destroys, so T doesn't
+   need a default constructor and nothing holds on to resources after it has been popped.
+
+**/
+
+#define QUEUE_MIN_CAPACITY 16
+
 template <typename T>
-struct Queue { 
-    // The container for the queue.
-    Array <T> data;
-    // You get this for free from Array but we can just track it here.
-    u64 size;
+struct Queue {
+    T  *data     = NULL;
+    u64 capacity = 0; // Always 0 or a power of 2.
+    u64 head     = 0; // Slot of the front element.
+    // You can access this on the struct however queue_size is there for completeness.
+    u64 size     = 0;
 };
 
+//
+// Internal functions
+//
 template <typename T>
-inline void queue_init(Queue<T> *queue) { 
-    array_init(&queue->data);
-    queue->size = 0;
+inline T *queue_slot(Queue<T> *queue, u64 index) {
+    return &queue->data[(queue->head + index) & (queue->capacity - 1)];
 }
 
+// Moves the live elements into a fresh buffer of new_capacity slots, front element first.
 template <typename T>
-inline void queue_deinit(Queue<T> *queue) { 
-    array_deinit(&queue->data);
-    queue->size = 0;
+void queue_relocate(Queue<T> *queue, u64 new_capacity) {
+    assert(new_capacity >= queue->size);
+
+    T *new_data = NULL;
+    if (new_capacity) {
+        new_data = (T *)malloc(new_capacity * sizeof(T));
+        assert(new_data);
+    }
+
+    if (queue->size) {
+        // The live range is at most two spans: head to the end of the buffer and the wrapped part at the start.
+        u64 first  = queue->capacity - queue->head;
+        if (first > queue->size) { first = queue->size; }
+        u64 second = queue->size - first;
+
+        T *spans[2]       = { queue->data + queue->head, queue->data };
+        u64 span_sizes[2] = { first, second };
+        T *destination    = new_data;
+
+        for (s32 s = 0; s < 2; ++s) {
+            if (std::is_trivially_copyable<T>::value) {
+                memcpy((void *)destination, (void *)spans[s], span_sizes[s] * sizeof(T));
+            } else {
+                for (u64 i = 0; i < span_sizes[s]; ++i) {
+                    new (&destination[i]) T(std::move(spans[s][i]));
+                    spans[s][i].~T();
+                }
+            }
+            destination += span_sizes[s];
+        }
+    }
+
+    free(queue->data);
+    queue->data     = new_data;
+    queue->capacity = new_capacity;
+    queue->head     = 0;
 }
 
+// Splits count slots starting at the index'th live element into the part before the end of the buffer and the
+// part that wraps around to the start. Returns the number of slots in the first part.
 template <typename T>
-inline void queue_push(Queue<T> *queue, T value) { 
-    array_push(&queue->data, value);
+inline u64 queue_first_span(Queue<T> *queue, u64 index, u64 count) {
+    u64 start = (queue->head + index) & (queue->capacity - 1);
+    u64 first = queue->capacity - start;
+    return (first < count) ? first : count;
+}
+
+template <typename T>
+inline void queue_grow(Queue<T> *queue, u64 want_capacity) {
+    u64 new_capacity = queue->capacity ? queue->capacity : QUEUE_MIN_CAPACITY;
+    while (new_capacity < want_capacity) { new_capacity *= 2; }
+    if (new_capacity != queue->capacity) { queue_relocate(queue, new_capacity); }
+}
+
+//
+// Interface
+//
+template <typename T>
+inline void queue_init(Queue<T> *queue) {
+    queue->data     = NULL;
+    queue->capacity = 0;
+    queue->head     = 0;
+    queue->size     = 0;
+}
+
+// Starts out with room for at least capacity elements.
+template <typename T>
+inline void queue_init(Queue<T> *queue, u64 capacity) {
+    queue_init(queue);
+    if (capacity) { queue_grow(queue, capacity); }
+}
+
+template <typename T>
+inline void queue_deinit(Queue<T> *queue) {
+    if (!std::is_trivially_destructible<T>::value) {
+        for (u64 i = 0; i < queue->size; ++i) { queue_slot(queue, i)->~T(); }
+    }
+    free(queue->data);
+    queue_init(queue);
+}
+
+template <typename T>
+inline void queue_reserve(Queue<T> *queue, u64 want_capacity) {
+    if (want_capacity > queue->capacity) { queue_grow(queue, want_capacity); }
+}
+
+template <typename T>
+inline bool queue_owns(Queue<T> *queue, const T *pointer) {
+    return pointer >= queue->data && pointer < queue->data + queue->capacity;
+}
+
+template <typename T>
+inline void queue_push(Queue<T> *queue, const T &value) {
+    if (queue->size == queue->capacity) {
+        // value may live in the queue itself, growing frees the buffer it is in.
+        if (queue_owns(queue, &value)) {
+            T copy(value);
+            queue_grow(queue, queue->size + 1);
+            new (queue_slot(queue, queue->size)) T(std::move(copy));
+            ++queue->size;
+            return;
+        }
+        queue_grow(queue, queue->size + 1);
+    }
+    new (queue_slot(queue, queue->size)) T(value);
     ++queue->size;
 }
 
-template <typename T> 
-inline T &queue_peek_front(Queue<T> *queue) { 
-    return array_peek_front(&queue->data);
+template <typename T>
+inline void queue_push(Queue<T> *queue, T &&value) {
+    if (queue->size == queue->capacity) {
+        if (queue_owns(queue, &value)) {
+            T moved(std::move(value));
+            queue_grow(queue, queue->size + 1);
+            new (queue_slot(queue, queue->size)) T(std::move(moved));
+            ++queue->size;
+            return;
+        }
+        queue_grow(queue, queue->size + 1);
+    }
+    new (queue_slot(queue, queue->size)) T(std::move(value));
+    ++queue->size;
+}
+
+template <typename T>
+inline T &queue_peek_front(Queue<T> *queue) {
+    assert(queue->size > 0);
+    return *queue_slot(queue, 0);
 }
 
-template <typename T> 
-inline T &queue_peek_back(Queue<T> *queue) { 
-    return array_peek_back(&queue->data);
+template <typename T>
+inline T &queue_peek_back(Queue<T> *queue) {
+    assert(queue->size > 0);
+    return *queue_slot(queue, queue->size - 1);
 }
 
 template <typename T>
-inline bool queue_empty(Queue<T> *queue) { 
+inline bool queue_empty(Queue<T> *queue) {
     bool empty = (queue->size == 0);
     return empty;
 }
 
 // You can acceess this on the struct however this is here for completeness.
 template <typename T>
-inline u64 queue_size(Queue<T> *queue) { 
+inline u64 queue_size(Queue<T> *queue) {
     return queue->size;
 }
 
+// Returns the front element by value, its slot is free for reuse as soon as this returns.
+template <typename T>
+T queue_pop(Queue<T> *queue) {
+    assert(queue->size > 0);
+    T *slot = queue_slot(queue, 0);
+    T result(std::move(*slot));
+    slot->~T();
+
+    queue->head = (queue->head + 1) & (queue->capacity - 1);
+    --queue->size;
+    return result;
+}
+
+// Shrinks the buffer to the smallest power of 2 that holds what is queued right now, or frees it if the
+// queue is empty.
+template <typename T>
+void queue_shrink_to_fit(Queue<T> *queue) {
+    u64 new_capacity = 0;
+    if (queue->size) {
+        new_capacity = QUEUE_MIN_CAPACITY;
+        while (new_capacity < queue->size) { new_capacity *= 2; }
+    }
+    if (new_capacity < queue->capacity) { queue_relocate(queue, new_capacity); }
+}
+
+// Pushes count elements in one go: at most one grow and two copies around the wrap point.
 template <typename T>
-T &queue_pop(Queue<T> *queue) { 
-    if (queue->size) { 
-        T &ret = array_pop_front(&queue->data);
-        --queue->size;
-        return ret;
+void queue_push_many(Queue<T> *queue, const T *values, u64 count) {
+    if (!count) { return; }
+    if (queue->size + count > queue->capacity) {
+        // values may be elements of this queue, growing frees the buffer they are in. Copy them out first.
+        if (queue_owns(queue, values)) {
+            T *staged = (T *)malloc(count * sizeof(T));
+            assert(staged);
+            for (u64 i = 0; i < count; ++i) { new (&staged[i]) T(values[i]); }
+
+            queue_push_many(queue, (const T *)staged, count);
+
+            if (!std::is_trivially_destructible<T>::value) {
+                for (u64 i = 0; i < count; ++i) { staged[i].~T(); }
+            }
+            free(staged);
+            return;
+        }
+        queue_grow(queue, queue->size + count);
+    }
+
+    u64 first    = queue_first_span(queue, queue->size, count);
+    T  *spans[2] = { queue_slot(queue, queue->size), queue->data };
+    u64 sizes[2] = { first, count - first };
+
+    for (s32 s = 0; s < 2; ++s) {
+        if (std::is_trivially_copyable<T>::value) {
+            memcpy((void *)spans[s], (const void *)values, sizes[s] * sizeof(T));
+        } else {
+            for (u64 i = 0; i < sizes[s]; ++i) { new (&spans[s][i]) T(values[i]); }
+        }
+        values += sizes[s];
+    }
+    queue->size += count;
+}
+
+// Pops up to max elements from the front into out, which must already hold max constructed (or trivial) Ts.
+// Returns how many were popped.
+template <typename T>
+u64 queue_pop_many(Queue<T> *queue, T *out, u64 max) {
+    u64 count = (queue->size < max) ? queue->size : max;
+    if (!count) { return 0; }
+
+    u64 first    = queue_first_span(queue, 0, count);
+    T  *spans[2] = { queue_slot(queue, 0), queue->data };
+    u64 sizes[2] = { first, count - first };
+
+    for (s32 s = 0; s < 2; ++s) {
+        if (std::is_trivially_copyable<T>::value) {
+            memcpy((void *)out, (void *)spans[s], sizes[s] * sizeof(T));
+        } else {
+            for (u64 i = 0; i < sizes[s]; ++i) {
+                out[i] = std::move(spans[s][i]);
+                spans[s][i].~T();
+            }
+        }
+        out += sizes[s];
     }
-    
+
+    queue->head  = (queue->head + count) & (queue->capacity - 1);
+    queue->size -= count;
+    return count;
 }
 
+// Calls function(T &) on every queued element front to back, in place, then empties the queue. Walks the two
+// spans directly instead of going through a pop per element.
+template <typename T, typename Function>
+void queue_drain(Queue<T> *queue, Function &&function) {
+    if (!queue->size) { return; }
+
+    u64 count    = queue->size;
+    u64 first    = queue_first_span(queue, 0, count);
+    T  *spans[2] = { queue_slot(queue, 0), queue->data };
+    u64 sizes[2] = { first, count - first };
+
+    for (s32 s = 0; s < 2; ++s) {
+        for (u64 i = 0; i < sizes[s]; ++i) {
+            function(spans[s][i]);
+            if (!std::is_trivially_destructible<T>::value) { spans[s][i].~T(); }
+        }
+    }
+
+    queue->head = 0;
+    queue->size = 0;
+}
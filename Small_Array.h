@@ -0,0 +1,187 @@
+#pragma once
+
+#include "Types.h"
+#include "Array.h"
+
+#include <assert.h>
+#include <new>
+#include <utility>
+
+/**
+
+   An Array that keeps its first N elements inside the struct and only goes to the allocator once it outgrows
+   them. Most small containers never leave the inline storage, so they cost no allocation and no pointer chase.
+
+   It takes the same array_* calls as Array. The inline storage and the heap pointer share a union, capacity says
+   which one is live (capacity == N means inline), so the struct stays valid if it is memcpy'd around.
+
+   A default constructed Small_Array is already usable, array_init is only needed to hand it an allocator.
+
+**/
+
+template <typename T, s32 N>
+struct Small_Array {
+    static_assert(N > 0, "Small_Array needs at least one inline element, use Array otherwise.");
+
+    s32 size     = 0;
+    s32 capacity = N;
+
+    Allocator *allocator = NULL; // Only used once we spill, NULL is the heap.
+
+    union {
+        T *heap;
+        alignas(T) u8 storage[N * sizeof(T)];
+    };
+
+    Small_Array() {}
+
+    T *items() { return (capacity > N) ? heap : (T *)storage; }
+    const T *items() const { return (capacity > N) ? heap : (const T *)storage; }
+
+    T &operator [](const s32 index) {
+        assert(index >= 0);
+        assert((s32)index < size);
+        return items()[index];
+    }
+
+    const T &operator [](const s32 index) const {
+        assert(index >= 0);
+        assert((s32)index < size);
+        return items()[index];
+    }
+
+    T *begin()             { return items(); }
+    const T *begin() const { return items(); }
+    T *end()               { return items() + size; }
+    const T *end() const   { return items() + size; }
+};
+
+template <typename T, s32 N>
+struct Is_Trivially_Relocatable <Small_Array <T, N>> : Is_Trivially_Relocatable <T> {};
+
+template <typename T, s32 N>
+inline bool array_is_inline(Small_Array <T, N> *array) {
+    return array->capacity == N;
+}
+
+//
+// Internal functions
+//
+template <typename T, s32 N>
+static void array_allocate_and_copy(Small_Array <T, N> *array, s32 new_capacity) {
+    if (new_capacity <= array->capacity) { return; }
+
+    T *new_data = (T *)allocator_allocate(array->allocator, (u64)new_capacity*sizeof(T));
+    assert(new_data);
+    array_relocate(new_data, array->items(), array->size);
+
+    if (!array_is_inline(array)) {
+        allocator_deallocate(array->allocator, (void *)array->heap, (u64)array->capacity*sizeof(T));
+    }
+    array->heap     = new_data;
+    array->capacity = new_capacity;
+}
+
+//
+// Interface
+//
+template <typename T, s32 N>
+void array_init(Small_Array <T, N> *array, Allocator *allocator=NULL) {
+    array->size      = 0;
+    array->capacity  = N;
+    array->allocator = allocator;
+}
+
+template <typename T, s32 N>
+void array_deinit(Small_Array <T, N> *array) {
+    array_destroy(array->items(), array->size);
+    if (!array_is_inline(array)) {
+        allocator_deallocate(array->allocator, (void *)array->heap, (u64)array->capacity*sizeof(T));
+    }
+    array->size     = 0;
+    array->capacity = N;
+}
+
+template <typename T, s32 N>
+void array_reserve(Small_Array <T, N> *array, s32 want_capacity) {
+    if (array->capacity >= want_capacity) { return; }
+    array_allocate_and_copy(array, want_capacity);
+}
+
+template <typename T, s32 N, typename... Args>
+T &array_emplace(Small_Array <T, N> *array, Args &&... args) {
+    if (array->capacity == array->size) {
+        array_allocate_and_copy(array, ARRAY_GROWTH_FORMULA(array->capacity));
+    }
+
+    T *result = new (&array->items()[array->size]) T(std::forward<Args>(args)...);
+    array->size++;
+    return *result;
+}
+
+template <typename T, s32 N>
+void array_add(Small_Array <T, N> *array, const T &value) {
+    // value may live in the array itself, spilling would leave the reference dangling.
+    if (array->capacity == array->size && &value >= array->begin() && &value < array->end()) {
+        T copy(value);
+        array_emplace(array, std::move(copy));
+        return;
+    }
+    array_emplace(array, value);
+}
+
+template <typename T, s32 N>
+void array_add(Small_Array <T, N> *array, T &&value) {
+    if (array->capacity == array->size && &value >= array->begin() && &value < array->end()) {
+        T moved(std::move(value));
+        array_emplace(array, std::move(moved));
+        return;
+    }
+    array_emplace(array, std::move(value));
+}
+
+template <typename T, s32 N>
+inline void array_push(Small_Array <T, N> *array, const T &value) {
+    array_add(array, value);
+}
+
+template <typename T, s32 N>
+inline void array_push(Small_Array <T, N> *array, T &&value) {
+    array_add(array, std::move(value));
+}
+
+template <typename T, s32 N>
+inline T &array_peek(Small_Array <T, N> *array) {
+    assert(array->size > 0);
+    return array->items()[array->size-1];
+}
+
+template <typename T, s32 N>
+inline T *array_peek_pointer(Small_Array <T, N> *array) {
+    assert(array->size > 0);
+    return &array->items()[array->size-1];
+}
+
+template <typename T, s32 N>
+inline T &array_peek_front(Small_Array <T, N> *array) {
+    assert(array->size > 0);
+    return array->items()[0];
+}
+
+template <typename T, s32 N>
+inline T &array_peek_back(Small_Array <T, N> *array) {
+    return array_peek(array);
+}
+
+template <typename T, s32 N>
+void array_resize(Small_Array <T, N> *array, s32 size) {
+    if (size > array->capacity) { array_allocate_and_copy(array, size); }
+
+    T *items = array->items();
+    if (size > array->size) {
+        for (s32 i = array->size; i < size; ++i) { new (&items[i]) T(); }
+    } else {
+        array_destroy(items + size, array->size - size);
+    }
+    array->size = size;
+}
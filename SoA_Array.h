@@ -0,0 +1,162 @@
+#pragma once
+
+#include "Types.h"
+#include "Allocator.h"
+#include "Array.h"
+
+#include <assert.h>
+#include <tuple>
+#include <utility>
+
+/**
+
+   Structure of arrays: every field lives in its own Array, so a loop that only reads positions only pulls
+   positions through the cache instead of whole structs.
+
+   The field types come in as the template arguments, the first argument is a struct of references that gives
+   them names. arr[i] returns one of those bound to element i, so arr[i].x reads and writes like it would on an
+   Array of structs.
+
+       struct Particle_Ref { f32 &x; f32 &y; s32 &id; };
+
+       SoA_Array <Particle_Ref, f32, f32, s32> particles;
+       array_init(&particles);
+       array_add(&particles, 1.0f, 2.0f, 7);
+       particles[0].x += 1.0f;
+
+       SoA_Span <f32> xs = soa_span<0>(&particles); // Contiguous, for the loops that need to vectorize.
+
+   All field arrays are kept the same size: add, remove and resize apply to every field together. Without an
+   allocator the fields come from cache_line_allocator so every span starts on a cache line.
+
+**/
+
+template <typename T>
+struct SoA_Span {
+    T  *data = NULL;
+    s32 size = 0;
+
+    T &operator [](const s32 index) {
+        assert(index >= 0);
+        assert(index < size);
+        return data[index];
+    }
+
+    T *begin() { return data; }
+    T *end()   { return data + size; }
+};
+
+// Wraps a field type so array_add takes it as declared instead of deducing it from the argument.
+template <typename T>
+struct SoA_Field { typedef T Type; };
+
+template <typename Ref, typename... Fields>
+struct SoA_Array {
+    static_assert(sizeof...(Fields) > 0, "SoA_Array needs at least one field.");
+
+    std::tuple<Array <Fields>...> fields;
+    s32 size = 0; // Same as the size of every field array.
+
+    Ref operator [](const s32 index);
+};
+
+//
+// Internal functions
+//
+
+// Calls function(field_array) on every field array in order.
+template <typename Function, typename... Arrays, size_t... I>
+inline void soa_for_each_field(std::tuple<Arrays...> &fields, Function &&function, std::index_sequence<I...>) {
+    int expand[] = { 0, (function(std::get<I>(fields)), 0)... };
+    (void)expand;
+}
+
+template <typename Ref, typename... Fields, typename Function>
+inline void soa_for_each_field(SoA_Array <Ref, Fields...> *array, Function &&function) {
+    soa_for_each_field(array->fields, function, std::index_sequence_for<Fields...>());
+}
+
+template <typename Ref, typename... Fields, size_t... I>
+inline Ref soa_make_ref(SoA_Array <Ref, Fields...> *array, s32 index, std::index_sequence<I...>) {
+    return Ref { std::get<I>(array->fields).data[index]... };
+}
+
+template <typename Ref, typename... Fields, typename... Values, size_t... I>
+inline void soa_add_fields(SoA_Array <Ref, Fields...> *array, std::index_sequence<I...>, Values &&... values) {
+    int expand[] = { 0, (array_add(&std::get<I>(array->fields), std::forward<Values>(values)), 0)... };
+    (void)expand;
+}
+
+template <typename Ref, typename... Fields>
+Ref SoA_Array <Ref, Fields...>::operator [](const s32 index) {
+    assert(index >= 0);
+    assert(index < size);
+    return soa_make_ref(this, index, std::index_sequence_for<Fields...>());
+}
+
+//
+// Interface
+//
+template <typename Ref, typename... Fields>
+void array_init(SoA_Array <Ref, Fields...> *array, Allocator *allocator=NULL) {
+    if (!allocator) { allocator = &cache_line_allocator; }
+    soa_for_each_field(array, [allocator](auto &field) { array_init(&field, allocator); });
+    array->size = 0;
+}
+
+template <typename Ref, typename... Fields>
+void array_deinit(SoA_Array <Ref, Fields...> *array) {
+    soa_for_each_field(array, [](auto &field) { array_deinit(&field); });
+    array->size = 0;
+}
+
+template <typename Ref, typename... Fields>
+void array_reserve(SoA_Array <Ref, Fields...> *array, s32 want_capacity) {
+    soa_for_each_field(array, [want_capacity](auto &field) { array_reserve(&field, want_capacity); });
+}
+
+// Takes one value per field, in field order. Each converts to its field's type, so 1.0 is fine for an f32.
+template <typename Ref, typename... Fields>
+void array_add(SoA_Array <Ref, Fields...> *array, typename SoA_Field<Fields>::Type... values) {
+    soa_add_fields(array, std::index_sequence_for<Fields...>(), std::move(values)...);
+    array->size++;
+}
+
+// Grows or shrinks every field to exactly size elements, new ones are value initialized.
+template <typename Ref, typename... Fields>
+void array_resize(SoA_Array <Ref, Fields...> *array, s32 size) {
+    soa_for_each_field(array, [size](auto &field) { array_resize(&field, size); });
+    array->size = size;
+}
+
+// Removes element index and shifts everything after it down, keeping the order.
+template <typename Ref, typename... Fields>
+void array_remove(SoA_Array <Ref, Fields...> *array, s32 index) {
+    assert(index >= 0 && index < array->size);
+    soa_for_each_field(array, [index](auto &field) {
+        for (s32 i = index; i + 1 < field.size; ++i) { field.data[i] = std::move(field.data[i + 1]); }
+        array_resize(&field, field.size - 1);
+    });
+    array->size--;
+}
+
+// Removes element index by moving the last element into its place, O(1) but doesn't keep the order.
+template <typename Ref, typename... Fields>
+void array_remove_unordered(SoA_Array <Ref, Fields...> *array, s32 index) {
+    assert(index >= 0 && index < array->size);
+    soa_for_each_field(array, [index](auto &field) {
+        if (index != field.size - 1) { field.data[index] = std::move(field.data[field.size - 1]); }
+        array_resize(&field, field.size - 1);
+    });
+    array->size--;
+}
+
+// Field N of every element, contiguous.
+template <size_t N, typename Ref, typename... Fields>
+inline auto soa_span(SoA_Array <Ref, Fields...> *array) -> SoA_Span <typename std::tuple_element<N, std::tuple<Fields...>>::type> {
+    auto &field = std::get<N>(array->fields);
+    SoA_Span <typename std::tuple_element<N, std::tuple<Fields...>>::type> span;
+    span.data = field.data;
+    span.size = field.size;
+    return span;
+}
@@ -2,6 +2,7 @@
 #define String_H
 
 #include "Types.h"
+#include "Allocator.h"
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -9,13 +10,18 @@
 #define MAX_STRING_INDEX 0x7fffffff
 // Carrying around this state of allocated = true is very annoying
 // and easy to get wrong -> leading to memory leakage.
+//
+// The buffer comes from 'allocator', the heap when it's NULL (see Allocator.h). A copy goes to the heap unless
+// it is given an allocator of its own, so copying a string out of an arena doesn't tie it to the arena.
 struct string {
     string() = default;
     ~string();
 
-    string(s32 _count, char fill);
-    string(const char *rhs);
+    string(s32 _count, char fill, Allocator *_allocator=NULL);
+    string(const char *rhs, Allocator *_allocator=NULL);
     string(const string &rhs);
+    string(const string &rhs, Allocator *_allocator);
+    string(string &&rhs);
     string &operator=(string rhs);
 
     string &operator+=(string &rhs);
@@ -69,26 +75,51 @@ struct string {
         assert(false);
     }
 
-    u8  *data        = NULL;
-    s32  count       = 0;
-    bool allocated   = false;
+    u8        *data      = NULL;
+    Allocator *allocator = NULL;
+    s32        count     = 0;
+    s32        capacity  = 0; // Bytes in data when allocated, the allocator needs it back on free.
+    bool       allocated = false;
 };
 
-char char_to_lower(char character) {
+// Allocates a buffer from the string's allocator without touching the current one.
+inline u8 *string_allocate(string *str, s32 bytes) {
+    return (u8 *)allocator_allocate(str->allocator, (u64)bytes);
+}
+
+// Frees the current buffer if the string owns it.
+inline void string_release(string *str) {
+    if (str->allocated && str->data) {
+        allocator_deallocate(str->allocator, str->data, (u64)str->capacity);
+    }
+    str->data      = NULL;
+    str->capacity  = 0;
+    str->allocated = false;
+}
+
+// Replaces the buffer with one the string owns.
+inline void string_adopt(string *str, u8 *buffer, s32 bytes) {
+    string_release(str);
+    str->data      = buffer;
+    str->capacity  = bytes;
+    str->allocated = true;
+}
+
+inline char char_to_lower(char character) {
     if (character >= 'A' && character <='Z') {
         return character + ' ';
     }
     return character;
 }
 
-char char_to_upper(char character) {
+inline char char_to_upper(char character) {
     if (character >= 'a' && character <= 'z') {
         return character - ' ';
     }
     return character;
 }
 
-s32 strcmp(const char *p1, const char *p2) {
+inline s32 strcmp(const char *p1, const char *p2) {
     if (p1 == NULL && p2 != NULL) { return -1; }
     if (p1 == NULL && p2 == NULL) { return  0; }
     if (p1 != NULL && p2 == NULL) { return  1; }
@@ -106,7 +137,7 @@ s32 strcmp(const char *p1, const char *p2) {
     return c1 - c2;
 }
 
-string make_literal(const char *s) {
+inline string make_literal(const char *s) {
     string str;
     if (s == NULL) { return str; }
     str.count = strlen(s);
@@ -114,7 +145,7 @@ string make_literal(const char *s) {
     return str;
 }
 
-string make_literal(const char *s, s32 count) {
+inline string make_literal(const char *s, s32 count) {
     string str;
     if (count == 0) {
         count = strlen(s);
@@ -124,132 +155,122 @@ string make_literal(const char *s, s32 count) {
     return str;
 }
 
-string &string::operator+=(const char *rhs) {
+inline string &string::operator+=(const char *rhs) {
     s32 rhs_count = strlen(rhs);
     if (rhs_count == 0 && count == 0) { return *this; }
     s32 total_count = rhs_count + count;
-    u8 *buffer      = new u8[total_count+1]; // for nul terminator.
+    u8 *buffer      = string_allocate(this, total_count+1); // for nul terminator.
     memmove(buffer, data, count);
     memmove(buffer+count, rhs, rhs_count);
     buffer[total_count] = '\0';
-    if (allocated) {
-        if (data) {
-            delete[] data;
-            data = NULL;
-        }
-    }
-    data  = buffer;
+    string_adopt(this, buffer, total_count+1);
     count = total_count;
-    allocated = true;
     return *this;
 }
 
-string &string::operator+=(string &rhs) {
+inline string &string::operator+=(string &rhs) {
     if (rhs.count == 0 && count == 0) { return *this; }
     s32 total_count = count + rhs.count;
-    u8 *buffer      = new u8[total_count+1]; // for nul terminator.
+    u8 *buffer      = string_allocate(this, total_count+1); // for nul terminator.
     memmove(buffer, data, count);
     memmove(buffer+count, rhs.data, rhs.count);
     buffer[total_count] = '\0';
-    if (allocated) {
-        if (data) {
-            delete[] data;
-            data = NULL;
-        }
-    }
-    data  = buffer;
+    string_adopt(this, buffer, total_count+1);
     count = total_count;
-    allocated = true;
     return *this;
 }
 
-bool string::operator==(string &rhs) {
+inline bool string::operator==(string &rhs) {
     if (strcmp((const char *)data, (const char *)rhs.data)) { return false; }
     return true;
 }
 
-bool string::operator==(const char *rhs) {
+inline bool string::operator==(const char *rhs) {
     if (strcmp((const char *)data, rhs)) { return false; }
     return true;
 }
 
-string::string(s32 _count, char fill) {
-    data  = new u8[_count+1]; // nul terminator
+inline string::string(s32 _count, char fill, Allocator *_allocator) {
+    allocator = _allocator;
+    string_adopt(this, string_allocate(this, _count+1), _count+1); // nul terminator
     count = _count;
     memset(data, fill, count);
-    allocated = true;
+    data[count] = '\0';
 }
 
-string::string(const string &rhs) {
+inline string::string(const string &rhs) {
     count = rhs.count;
-    data  = new u8[count+1]; // nul terminator
+    string_adopt(this, string_allocate(this, count+1), count+1); // nul terminator
+    memmove(data, rhs.data, rhs.count);
+    data[count] = '\0';
+}
+
+inline string::string(const string &rhs, Allocator *_allocator) {
+    allocator = _allocator;
+    count     = rhs.count;
+    string_adopt(this, string_allocate(this, count+1), count+1); // nul terminator
     memmove(data, rhs.data, rhs.count);
-    allocated = true;
+    data[count] = '\0';
+}
+
+// Takes over rhs's buffer, rhs is left empty. This is what lets an Array of strings grow without copying
+// every string.
+inline string::string(string &&rhs) {
+    data      = rhs.data;
+    allocator = rhs.allocator;
+    count     = rhs.count;
+    capacity  = rhs.capacity;
+    allocated = rhs.allocated;
+    rhs.data      = NULL;
+    rhs.count     = 0;
+    rhs.capacity  = 0;
+    rhs.allocated = false;
 }
 
 // This only gets called once per instance so we don't need to delete
 // the data before we allocate it. We just need to set the allocated flag.
-string::string(const char *rhs) {
+inline string::string(const char *rhs, Allocator *_allocator) {
     auto rhs_count = strlen(rhs);
-    data = new u8[rhs_count+1]; // nul terminator
+    allocator = _allocator;
+    string_adopt(this, string_allocate(this, rhs_count+1), rhs_count+1); // nul terminator
     memmove(data, rhs, rhs_count);
     data[rhs_count] = '\0';
     count           = rhs_count;
-    allocated       = true;
 }
 
-string &string::operator=(string rhs) {
+inline string &string::operator=(string rhs) {
     if (rhs.count == 0) {
         count = strlen((const char *)rhs.data);
     }
     count = rhs.count;
-    delete[] data;
-    data = new u8[count+1]; // nul terminator
+    // Keeps this string's allocator, only the contents are assigned.
+    string_adopt(this, string_allocate(this, count+1), count+1); // nul terminator
     memmove((void *)data, (void *)rhs.data, rhs.count);
     data[count] = '\0';
-    allocated   = true;
     return *this;
 }
 
-string::~string() {
-    if (allocated) {
-        if (data) {
-            delete[] data;
-            data = NULL;
-        }
-    }
+inline string::~string() {
+    string_release(this);
     count = 0;
 }
 
-char *string::raw()    { return (char *)data; }
-u32   string::size()   { return count; }
-u32   string::length() { return count; }
-bool  string::empty()  { return count == 0; }
+inline char *string::raw()    { return (char *)data; }
+inline u32   string::size()   { return count; }
+inline u32   string::length() { return count; }
+inline bool  string::empty()  { return count == 0; }
 
-void string::reset() {
-    if (allocated) {
-        if (data) {
-            delete[] data;
-        }
-    }
-    data      = NULL;
-    count     = 0;
-    allocated = false;
+inline void string::reset() {
+    string_release(this);
+    count = 0;
 }
 
-void string::reserve(s32 bytes) {
+inline void string::reserve(s32 bytes) {
     if (bytes < 0) { return; }
-    if (allocated) {
-        if (data) {
-            delete[] data;
-            data = NULL;
-        }
-    }
-    data      = new u8[bytes];
-    allocated = true;
+    string_adopt(this, string_allocate(this, bytes), bytes);
 }
 
-string &string::to_lower() {
+inline string &string::to_lower() {
     if (count == 0) { return *this; }
     for (int i = 0; i < count; ++i) {
         data[i] = char_to_lower((char)data[i]);
@@ -257,7 +278,7 @@ string &string::to_lower() {
     return *this;
 }
 
-string &string::to_upper() {
+inline string &string::to_upper() {
     if (count == 0) { return *this; }
     for (int i = 0; i < count; ++i) {
         data[i] = char_to_upper((char)data[i]);
@@ -265,34 +286,34 @@ string &string::to_upper() {
     return *this;
 }
 
-string string::substring(s32 low, s32 high) {
+inline string string::substring(s32 low, s32 high) {
     return make_literal((const char *)data+low, high-low);
 }
 
-string substring(string *str, s32 low, s32 high) {
+inline string substring(string *str, s32 low, s32 high) {
         return make_literal((const char *)(str->data+low), high-low);
 }
 
-u64 string_length(string *str) {
+inline u64 string_length(string *str) {
     if (str == NULL) { return 0; }
     return strlen((const char *)str->data);
 }
 
-u64 string_size(string *str) {
+inline u64 string_size(string *str) {
     return string_length(str);
 }
 
-s32 string_compare(string *str1, string *str2) {
+inline s32 string_compare(string *str1, string *str2) {
    if (strcmp((const char *)str1->data, (const char *)str2->data)) { return false; }
    return true;
 }
 
-s32 string_compare(string *str1, const char *str2) {
+inline s32 string_compare(string *str1, const char *str2) {
     if (strcmp((const char *)str1->data, str2)) { return false; }
     return true;
 }
 
-s32 string_compare_and_ignore_case(string *str1, string *str2) {
+inline s32 string_compare_and_ignore_case(string *str1, string *str2) {
     if (str1->count != str2->count) { return false; }
     u8 *str1_data_pointer = str1->data;
     u8 *str2_data_pointer = str2->data;
@@ -310,7 +331,7 @@ s32 string_compare_and_ignore_case(string *str1, string *str2) {
     return true;
 }
 
-s32 string_compare_and_ignore_case(string *str1, const char *str2) {
+inline s32 string_compare_and_ignore_case(string *str1, const char *str2) {
     if (str1->count != strlen(str2)) { return false; }
     char *str1_data_pointer = (char *)str1->data;
     char *str2_data_pointer = (char *)str2;
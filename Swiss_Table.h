@@ -0,0 +1,367 @@
+#pragma once
+
+#include "Types.h"
+#include "Hash.h"
+#include "Allocator.h"
+#include "Hash_Table.h" // Default_Hash, Default_Equal and Table_Key_Storage.
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define SWISS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_WIN32)
+#include <intrin.h>
+#endif
+
+/**
+
+   Swiss_Table is a drop in for Hash_Table with the same table_* calls, laid out for probing many slots at once.
+
+   Every slot has one control byte in a separate array: EMPTY, DELETED, or the top 7 bits of the key's hash when
+   the slot is full. A probe loads 16 control bytes, compares all of them against the hash fragment with one
+   SSE2 compare, and only looks at keys whose fragment matched, which is 1 in 128 of the wrong ones. A miss
+   usually ends at the first group because a group with an EMPTY byte ends the probe. Keys and values are in
+   their own arrays so none of that touches a value.
+
+   Groups are probed quadratically (1, 2, 3... groups apart), which visits every group once for a power of 2
+   group count. The table fills to 7/8 before it grows.
+
+   A removed slot goes straight back to EMPTY when its group still has an EMPTY byte, no probe can ever have
+   gone past such a group. Only in full groups does it become DELETED. Tombstones are dropped the next time the
+   table runs out of room, by a rehash at the same size if most of the used slots are tombstones.
+
+   Interned string keys are compacted the same way as in Hash_Table.
+
+**/
+
+#define SWISS_GROUP_WIDTH 16
+#define SWISS_MIN_SIZE    16
+
+const s8 SWISS_EMPTY   = -128; // 0b10000000
+const s8 SWISS_DELETED = -2;   // 0b11111110
+// Full slots hold 0 to 127, so a free slot is one with the top bit set.
+
+template <typename Key_Type, typename Value_Type, typename Hasher = Default_Hash<Key_Type>, typename Equal = Default_Equal<Key_Type>>
+struct Swiss_Table {
+    typedef bool (*Comparator_Function)(Key_Type, Key_Type);
+
+    s32 table_size;  // Slots, a power of 2 and at least one group.
+    s32 items;       // Full slots.
+    s32 deleted;     // DELETED slots.
+    s32 growth_left; // EMPTY slots that can still be filled before the table hits 7/8.
+
+    s8         *control; // table_size bytes, one per slot.
+    Key_Type   *keys;
+    Value_Type *values;
+
+    Hasher hasher;
+    Equal  equal;
+
+    // Optional overrides for hasher and equal, NULL unless given to table_init.
+    u32  (*hash_function)(void *, s32);
+    Comparator_Function comparator_function;
+
+    Allocator *allocator; // Where the slots come from, NULL is the heap.
+    Arena      interned;  // Characters of string keys, see Table_Key_Storage.
+    u64        interned_live; // The same accounting as Hash_Table.
+    u64        interned_dead;
+};
+
+//
+// Internal functions
+//
+inline s32 swiss_count_trailing_zeros(u32 x) {
+#if defined(_WIN32)
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (s32)index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+inline s8 swiss_fragment(u32 hash) { return (s8)(hash >> 25); }
+
+// One bit per slot of the group whose control byte is value.
+inline u32 swiss_match(const s8 *group, s8 value) {
+#if SWISS_SSE2
+    __m128i control = _mm_loadu_si128((const __m128i *)group);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(value)));
+#else
+    u32 mask = 0;
+    for (s32 i = 0; i < SWISS_GROUP_WIDTH; ++i) { if (group[i] == value) { mask |= 1u << i; } }
+    return mask;
+#endif
+}
+
+// EMPTY or DELETED, the slots with the top bit set.
+inline u32 swiss_match_free(const s8 *group) {
+#if SWISS_SSE2
+    return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    u32 mask = 0;
+    for (s32 i = 0; i < SWISS_GROUP_WIDTH; ++i) { if (group[i] < 0) { mask |= 1u << i; } }
+    return mask;
+#endif
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline u32 table_hash(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Key_Type &key) {
+    return table->hash_function ? table->hash_function((void *)&key, sizeof(key)) : table->hasher(key);
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline bool table_keys_equal(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Key_Type &a, const Key_Type &b) {
+    return table->comparator_function ? table->comparator_function(a, b) : table->equal(a, b);
+}
+
+template <typename Key_Type, typename Value_Type>
+inline u64 swiss_keys_offset(s32 table_size) {
+    return align_forward((u64)table_size, alignof(Key_Type) > ALLOCATOR_ALIGNMENT ? alignof(Key_Type) : ALLOCATOR_ALIGNMENT);
+}
+
+template <typename Key_Type, typename Value_Type>
+inline u64 swiss_values_offset(s32 table_size) {
+    return align_forward(swiss_keys_offset<Key_Type, Value_Type>(table_size) + (u64)table_size*sizeof(Key_Type), alignof(Value_Type) > ALLOCATOR_ALIGNMENT ? alignof(Value_Type) : ALLOCATOR_ALIGNMENT);
+}
+
+// Control bytes, keys and values share one block.
+template <typename Key_Type, typename Value_Type>
+inline u64 swiss_block_size(s32 table_size) {
+    return swiss_values_offset<Key_Type, Value_Type>(table_size) + (u64)table_size*sizeof(Value_Type);
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void swiss_allocate_slots(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, s64 _table_size) {
+    if (_table_size < SWISS_MIN_SIZE) { _table_size = SWISS_MIN_SIZE; }
+    s32 table_size = (s32)next_power_of_two((u32)_table_size);
+
+    u8 *block = (u8 *)allocator_allocate(table->allocator, swiss_block_size<Key_Type, Value_Type>(table_size));
+    assert(block);
+    memset(block, SWISS_EMPTY, table_size);
+    memset((void *)(block + swiss_keys_offset<Key_Type, Value_Type>(table_size)), 0, (u64)table_size*sizeof(Key_Type));
+    memset((void *)(block + swiss_values_offset<Key_Type, Value_Type>(table_size)), 0, (u64)table_size*sizeof(Value_Type));
+
+    table->control     = (s8 *)block;
+    table->keys        = (Key_Type *)(block + swiss_keys_offset<Key_Type, Value_Type>(table_size));
+    table->values      = (Value_Type *)(block + swiss_values_offset<Key_Type, Value_Type>(table_size));
+    table->table_size  = table_size;
+    table->items       = 0;
+    table->deleted     = 0;
+    table->growth_left = table_size - table_size / 8;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void swiss_free_slots(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, s8 *control, s32 table_size) {
+    allocator_deallocate(table->allocator, control, swiss_block_size<Key_Type, Value_Type>(table_size));
+}
+
+// First free slot on hash's probe sequence.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline s32 swiss_find_free(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, u32 hash) {
+    u32 groups_mask = (u32)(table->table_size / SWISS_GROUP_WIDTH) - 1;
+    u32 group       = hash & groups_mask;
+
+    for (u32 step = 1; ; ++step) {
+        u32 free = swiss_match_free(table->control + group * SWISS_GROUP_WIDTH);
+        if (free) { return (s32)(group * SWISS_GROUP_WIDTH) + swiss_count_trailing_zeros(free); }
+        group = (group + step) & groups_mask;
+    }
+}
+
+// Slot of key, -1 if it isn't there. Lookup is Key_Type or anything else equal can compare against it.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename Compare>
+inline s32 swiss_find_slot(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, u32 hash, const Lookup &key, Compare &&compare) {
+    u32 groups_mask = (u32)(table->table_size / SWISS_GROUP_WIDTH) - 1;
+    u32 group       = hash & groups_mask;
+    s8  fragment    = swiss_fragment(hash);
+
+    for (u32 step = 1; step <= groups_mask + 1; ++step) {
+        const s8 *control = table->control + group * SWISS_GROUP_WIDTH;
+
+        u32 matches = swiss_match(control, fragment);
+        while (matches) {
+            s32 slot = (s32)(group * SWISS_GROUP_WIDTH) + swiss_count_trailing_zeros(matches);
+            if (compare(table->keys[slot], key)) { return slot; }
+            matches &= matches - 1;
+        }
+
+        // An EMPTY byte means no key with this hash was ever pushed past this group.
+        if (swiss_match(control, SWISS_EMPTY)) { return -1; }
+        group = (group + step) & groups_mask;
+    }
+    return -1;
+}
+
+// Moves every full slot into a fresh block of new_size slots, dropping the tombstones.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void swiss_rehash(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, s64 new_size) {
+    s8         *old_control = table->control;
+    Key_Type   *old_keys    = table->keys;
+    Value_Type *old_values  = table->values;
+    s32         old_size    = table->table_size;
+
+    swiss_allocate_slots(table, new_size);
+
+    // Keys and values are moved as bytes, the same as Hash_Table, interned keys keep pointing into the arena.
+    for (s32 i = 0; i < old_size; ++i) {
+        if (old_control[i] < 0) { continue; }
+        u32 hash = table_hash(table, old_keys[i]);
+        s32 slot = swiss_find_free(table, hash);
+        table->control[slot] = swiss_fragment(hash);
+        memcpy((void *)&table->keys[slot],   (void *)&old_keys[i],   sizeof(Key_Type));
+        memcpy((void *)&table->values[slot], (void *)&old_values[i], sizeof(Value_Type));
+        table->items++;
+        table->growth_left--;
+    }
+
+    swiss_free_slots(table, old_control, old_size);
+}
+
+//
+// Interface
+//
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_init(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, s64 _table_size=0, typename Swiss_Table <Key_Type, Value_Type, Hasher, Equal>::Comparator_Function given_comparator=NULL, u32 (*given_hash_function)(void *, s32)=NULL, Allocator *allocator=NULL) {
+    table->hash_function       = given_hash_function;
+    table->comparator_function = given_comparator;
+    table->allocator           = allocator;
+
+    arena_init(&table->interned);
+    table->interned_live = 0;
+    table->interned_dead = 0;
+    swiss_allocate_slots(table, _table_size);
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_deinit(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table) {
+    swiss_free_slots(table, table->control, table->table_size);
+    table->control = NULL;
+    table->keys    = NULL;
+    table->values  = NULL;
+    arena_deinit(&table->interned);
+}
+
+// Doubles the table.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_expand(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table) {
+    swiss_rehash(table, (s64)table->table_size * 2);
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline Value_Type *table_find_pointer(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key) {
+    if (!table->table_size) { return NULL; }
+
+    s32 slot = swiss_find_slot(table, table_hash(table, key), key, [table](const Key_Type &a, const Key_Type &b) { return table_keys_equal(table, a, b); });
+    return (slot < 0) ? NULL : &table->values[slot];
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline bool table_find(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key) {
+    return table_find_pointer(table, key) != NULL;
+}
+
+// Like Hash_Table, add assumes the key isn't in the table yet. Use table_set when it might be.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_add(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key, Value_Type value) {
+    u32 hash = table_hash(table, key);
+    s32 slot = swiss_find_free(table, hash);
+
+    if (table->control[slot] == SWISS_EMPTY && table->growth_left == 0) {
+        // Mostly tombstones: clean them up in place. Otherwise grow.
+        bool mostly_deleted = table->deleted > table->items;
+        swiss_rehash(table, mostly_deleted ? table->table_size : (s64)table->table_size * 2);
+        slot = swiss_find_free(table, hash);
+    }
+
+    if (table->control[slot] == SWISS_DELETED) {
+        table->deleted--;
+    } else {
+        table->growth_left--;
+    }
+
+    table->control[slot] = swiss_fragment(hash);
+    table->interned_live += Table_Key_Storage<Key_Type>::store(&table->keys[slot], key, &table->interned);
+    table->values[slot] = value;
+    table->items++;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void table_set(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key, Value_Type new_value) {
+    Value_Type *old_value = table_find_pointer(table, key);
+    if (old_value) {
+        *old_value = new_value;
+    } else {
+        table_add(table, key, new_value);
+    }
+}
+
+// Copies the characters of every key still in the table into a fresh arena, see Hash_Table.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+void table_compact_keys(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table) {
+    Arena compacted;
+    arena_init(&compacted, table->interned.block_size);
+
+    for (s32 i = 0; i < table->table_size; ++i) {
+        if (table->control[i] >= 0) { Table_Key_Storage<Key_Type>::store(&table->keys[i], table->keys[i], &compacted); }
+    }
+
+    arena_deinit(&table->interned);
+    table->interned      = compacted;
+    table->interned_dead = 0;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline void swiss_erase_slot(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, s32 slot) {
+    u64 bytes = Table_Key_Storage<Key_Type>::size(table->keys[slot]);
+    table->interned_live -= bytes;
+    table->interned_dead += bytes;
+
+    const s8 *group = table->control + (slot & ~(SWISS_GROUP_WIDTH - 1));
+    if (swiss_match(group, SWISS_EMPTY)) {
+        table->control[slot] = SWISS_EMPTY;
+        table->growth_left++;
+    } else {
+        table->control[slot] = SWISS_DELETED;
+        table->deleted++;
+    }
+    table->items--;
+
+    if (table->interned_dead > table->interned_live + (u64)table->table_size) { table_compact_keys(table); }
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal>
+inline bool table_remove(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Table_Key_Argument<Key_Type> &key) {
+    s32 slot = swiss_find_slot(table, table_hash(table, key), key, [table](const Key_Type &a, const Key_Type &b) { return table_keys_equal(table, a, b); });
+    if (slot < 0) { return false; }
+    swiss_erase_slot(table, slot);
+    return true;
+}
+
+// Lookups by any type the hasher takes, see Hash_Table.
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+inline Value_Type *table_find_pointer(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup &key) {
+    if (table->hash_function || table->comparator_function) { return table_find_pointer(table, Table_Key_Storage<Key_Type>::make(key)); }
+
+    s32 slot = swiss_find_slot(table, table->hasher(key), key, table->equal);
+    return (slot < 0) ? NULL : &table->values[slot];
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+inline bool table_find(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup &key) {
+    return table_find_pointer(table, key) != NULL;
+}
+
+template <typename Key_Type, typename Value_Type, typename Hasher, typename Equal, typename Lookup, typename = Table_Transparent<Hasher, Key_Type, Lookup>>
+inline bool table_remove(Swiss_Table <Key_Type, Value_Type, Hasher, Equal> *table, const Lookup &key) {
+    if (table->hash_function || table->comparator_function) { return table_remove(table, Table_Key_Storage<Key_Type>::make(key)); }
+
+    s32 slot = swiss_find_slot(table, table->hasher(key), key, table->equal);
+    if (slot < 0) { return false; }
+    swiss_erase_slot(table, slot);
+    return true;
+}
@@ -1,80 +1,98 @@
 #pragma once
 
 #include "Types.h"
+#include "Topology.h"
 
 #if defined(_WIN32)
 #include <windows.h>
 #include <synchapi.h>
+#include <intrin.h>
 #endif
 
-#ifdef linux
+#if defined(__linux__)
 #include <semaphore.h>
 #include <pthread.h>
 #include <unistd.h>
 #endif
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h> // _mm_pause
+#endif
+
 #include <stdio.h>
 
 // A platform independent wrapper around multithreading primatives.
 
-void sleep_seconds(u32 seconds) { 
+inline void sleep_seconds(u32 seconds) { 
 #if defined(_WIN32)
     u32 milliseconds = seconds * 1000;
     Sleep(milliseconds);
 #endif
 
-#ifdef linux
+#if defined(__linux__)
     sleep(seconds);
 #endif
 }
 
+// Spin loop hint, tells the core we're busy waiting so it can back off and give the sibling hyperthread a turn.
+// Goes by the CPU rather than the OS, other CPUs just spin without the hint.
+inline void cpu_pause() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(_M_ARM64)
+    __yield();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
 struct Semaphore {
 #if defined(_WIN32)
     HANDLE semaphore_handle;
 #endif
 
-#ifdef linux
+#if defined(__linux__)
     sem_t semaphore_handle;
 #endif
 };
 
-void semaphore_create(Semaphore *semaphore, u32 count) {
+inline void semaphore_create(Semaphore *semaphore, u32 count) {
 #if defined(_WIN32)
     u64 value = (1 << 32) - 1;
     semaphore->semaphore_handle = CreateSemaphore(NULL, 0, value, NULL);
 #endif 
 
-#ifdef linux
+#if defined(__linux__)
     sem_init(&semaphore->semaphore_handle, 0, count);
 #endif
 }
 
-void semaphore_destroy(Semaphore *semaphore) { 
+inline void semaphore_destroy(Semaphore *semaphore) { 
 #if defined(_WIN32)
     CloseHandle(semaphore->semaphore_handle);
 #endif 
 
-#ifdef linux
+#if defined(__linux__)
     sem_destroy(&semaphore->semaphore_handle);
 #endif 
 }
 
-void semaphore_lock(Semaphore *semaphore) { 
+inline void semaphore_lock(Semaphore *semaphore) { 
 #if defined(_WIN32)
     WaitForSingleObjectEx(semaphore->semaphore_handle, INFINITE, FALSE);
 #endif 
 
-#ifdef linux
+#if defined(__linux__)
     sem_wait(&semaphore->semaphore_handle);
 #endif 
 }
 
-void semaphore_unlock(Semaphore *semaphore) { 
+inline void semaphore_unlock(Semaphore *semaphore) { 
 #if defined(_WIN32)
     ReleaseSemaphore(semaphore->semaphore_handle, 1, NULL);
 #endif 
 
-#ifdef linux
+#if defined(__linux__)
     sem_post(&semaphore->semaphore_handle);
 #endif 
 }
@@ -86,47 +104,47 @@ struct Mutex {
     SRWLOCK lock; // Reader | Writer lock.
 #endif
 
-#ifdef linux 
+#if defined(__linux__)
     pthread_mutex_t pthread_mutex;
 #endif 
 };
 
-void mutex_create(Mutex *mutex) { 
+inline void mutex_create(Mutex *mutex) { 
 #if defined(_WIN32)
     InitializeSRWLock(&mutex->lock);
 #endif
 
-#ifdef linux    
+#if defined(__linux__)
     pthread_mutex_init(&mutex->pthread_mutex, NULL);
 #endif
 }
 
-void mutex_destroy(Mutex *mutex) { 
+inline void mutex_destroy(Mutex *mutex) { 
 #if defined(_WIN32)
     return;
 #endif
 
-#ifdef linux
+#if defined(__linux__)
     pthread_mutex_destroy(&mutex->pthread_mutex);
 #endif
 }
 
-void mutex_lock(Mutex *mutex) { 
+inline void mutex_lock(Mutex *mutex) { 
 #if defined(_WIN32)
     AcquireSRWLockExclusive(&mutex->lock);
 #endif
 
-#ifdef linux
+#if defined(__linux__)
     pthread_mutex_lock(&mutex->pthread_mutex);
 #endif
 }
 
-void mutex_unlock(Mutex *mutex) { 
+inline void mutex_unlock(Mutex *mutex) { 
 #if defined(_WIN32)
     ReleaseSRWLockExclusive(&mutex->lock);
 #endif
 
-#ifdef linux
+#if defined(__linux__)
     pthread_mutex_unlock(&mutex->pthread_mutex);
 #endif
 }
@@ -166,7 +184,7 @@ struct Thread {
     HANDLE thread_handle;
 #endif 
 
-#ifdef linux
+#if defined(__linux__)
     pthread_attr_t thread_attributes;
     pthread_t thread_handle;
 #endif 
@@ -176,23 +194,23 @@ struct Thread {
     s32               id = 0;
 };
 
-void _thread_join(Thread *thread) {
+inline void _thread_join(Thread *thread) {
 #if defined(_WIN32)
     WaitForSingleObject(thread->thread_handle, INFINITE);
 #endif 
 
-#ifdef linux
+#if defined(__linux__)
     pthread_join(thread->thread_handle, NULL);
 #endif 
 }
 
-void thread_join(Thread *thread) { 
+inline void thread_join(Thread *thread) { 
 #if defined(_WIN32)
     _thread_join(thread);
     CloseHandle(thread->thread_handle);
 #endif 
 
-#ifdef linux
+#if defined(__linux__)
     pthread_attr_destroy(&thread->thread_attributes);
     _thread_join(thread);
 #endif 
@@ -200,32 +218,62 @@ void thread_join(Thread *thread) {
 
 // This is very annoying !!!!
 #if defined(_WIN32)
-DWORD WINAPI internal_thread_procedure(void *parameters) { 
+inline DWORD WINAPI internal_thread_procedure(void *parameters) { 
     Thread *t = (Thread *)parameters;
     t->procedure(t->context);
     return 0;
 }
 #endif 
 
-#ifdef linux
-void *internal_thread_procedure(void *parameters) { 
+#if defined(__linux__)
+inline void *internal_thread_procedure(void *parameters) { 
     Thread *t = (Thread *)parameters;
     t->procedure(t->context);
     pthread_exit(NULL);
 }
 #endif 
 
-void thread_start(Thread *thread, Thread_Procedure thread_procedure) {
+// cpu pins the thread before it runs any of thread_procedure, -1 leaves it wherever the OS puts it.
+inline void thread_start(Thread *thread, Thread_Procedure thread_procedure, s32 cpu=-1) {
     thread->procedure = thread_procedure;
     
 #if defined(_WIN32)
-    thread->thread_handle = CreateThread(NULL, 0, internal_thread_procedure, (void *)thread, 0, (LPDWORD)&thread->id);
+    if (cpu >= 0 && cpu < 64) {
+        thread->thread_handle = CreateThread(NULL, 0, internal_thread_procedure, (void *)thread, CREATE_SUSPENDED, (LPDWORD)&thread->id);
+        SetThreadAffinityMask(thread->thread_handle, (DWORD_PTR)1 << cpu);
+        ResumeThread(thread->thread_handle);
+    } else {
+        thread->thread_handle = CreateThread(NULL, 0, internal_thread_procedure, (void *)thread, 0, (LPDWORD)&thread->id);
+    }
 #endif 
 
-#ifdef linux
+#if defined(__linux__)
     pthread_attr_init(&thread->thread_attributes);
     pthread_attr_setdetachstate(&thread->thread_attributes, PTHREAD_CREATE_JOINABLE);
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_attr_setaffinity_np(&thread->thread_attributes, sizeof(set), &set);
+    }
     pthread_create(&thread->thread_handle, &thread->thread_attributes, internal_thread_procedure, (void *)thread);
     thread->id = thread->thread_handle;
 #endif 
 }
+
+// Starts count threads placed by policy, see Topology.h. Thread i goes on the i'th CPU of the policy's order.
+inline void threads_start(Thread *threads, s32 count, Thread_Procedure thread_procedure, Pin_Policy policy) {
+    s32 order[MAX_TOPOLOGY_CPUS];
+    s32 cpus = 0;
+
+    if (policy.policy != PIN_NONE) {
+        Cpu_Topology topology;
+        topology_init(&topology);
+        cpus = topology_pin_order(&topology, policy, order, MAX_TOPOLOGY_CPUS);
+        topology_deinit(&topology);
+    }
+
+    for (s32 i = 0; i < count; ++i) {
+        thread_start(&threads[i], thread_procedure, cpus ? order[i % cpus] : -1);
+    }
+}
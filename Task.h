@@ -0,0 +1,193 @@
+#pragma once
+
+#include "Types.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+/**
+
+   A move-only type erased 'void()' callable that keeps its captures inline.
+
+   std::function copies on every hand off and goes to the heap as soon as a capture outgrows its small buffer.
+   Inline_Task never allocates, the callable is move constructed straight into 'storage' and moved from slot to
+   slot after that. A callable that doesn't fit is a compile error rather than a silent allocation, raise
+   TASK_INLINE_SIZE (or use Inline_Task<N> directly) if you need bigger captures.
+
+   The default of 48 bytes makes a Task exactly one cache line, which is enough for a std::function or a
+   lambda capturing six pointers.
+
+**/
+
+#ifndef TASK_INLINE_SIZE
+#define TASK_INLINE_SIZE 48
+#endif
+
+#define TASK_INLINE_ALIGNMENT 16
+
+template <s64 Inline_Size>
+struct Inline_Task {
+    // invoke runs the callable in place. relocate move constructs it into destination and destroys the
+    // source, a NULL destination only destroys.
+    void (*invoke)(void *storage)                     = NULL;
+    void (*relocate)(void *destination, void *source) = NULL;
+
+    alignas(TASK_INLINE_ALIGNMENT) u8 storage[Inline_Size];
+
+    Inline_Task() = default;
+
+    template <typename Function, typename = typename std::enable_if<!std::is_same<typename std::decay<Function>::type, Inline_Task>::value>::type>
+    Inline_Task(Function &&function) {
+        typedef typename std::decay<Function>::type Callable;
+
+        static_assert(sizeof(Callable) <= Inline_Size, "Task capture is too big for the inline storage, raise TASK_INLINE_SIZE.");
+        static_assert(alignof(Callable) <= TASK_INLINE_ALIGNMENT, "Task capture is over aligned.");
+        static_assert(std::is_nothrow_move_constructible<Callable>::value, "Task captures must be nothrow movable.");
+
+        new (storage) Callable(std::forward<Function>(function));
+
+        invoke = [](void *s) { (*(Callable *)s)(); };
+
+        // Trivially copyable captures (the common pointer and integer lambdas) relocate with a memcpy.
+        if (std::is_trivially_copyable<Callable>::value) {
+            relocate = [](void *destination, void *source) {
+                if (destination) { memcpy(destination, source, sizeof(Callable)); }
+            };
+        } else {
+            relocate = [](void *destination, void *source) {
+                if (destination) { new (destination) Callable(std::move(*(Callable *)source)); }
+                ((Callable *)source)->~Callable();
+            };
+        }
+    }
+
+    Inline_Task(Inline_Task &&rhs) {
+        take(&rhs);
+    }
+
+    Inline_Task &operator=(Inline_Task &&rhs) {
+        if (this != &rhs) {
+            reset();
+            take(&rhs);
+        }
+        return *this;
+    }
+
+    Inline_Task &operator=(decltype(nullptr)) {
+        reset();
+        return *this;
+    }
+
+    Inline_Task(const Inline_Task &rhs)            = delete;
+    Inline_Task &operator=(const Inline_Task &rhs) = delete;
+
+    ~Inline_Task() {
+        reset();
+    }
+
+    void operator()() {
+        assert(invoke);
+        invoke(storage);
+    }
+
+    explicit operator bool() const { return invoke != NULL; }
+
+    void reset() {
+        if (relocate) { relocate(NULL, storage); }
+        invoke   = NULL;
+        relocate = NULL;
+    }
+
+    void take(Inline_Task *rhs) {
+        invoke   = rhs->invoke;
+        relocate = rhs->relocate;
+        if (relocate) { relocate(storage, rhs->storage); }
+        rhs->invoke   = NULL;
+        rhs->relocate = NULL;
+    }
+};
+
+typedef Inline_Task<TASK_INLINE_SIZE> Task;
+
+
+/**
+
+   FIFO on a power of 2 ring buffer, used for Tasks and for the scheduler's timestamped Tasks. Popped slots are
+   reused so a queue that is pushed and popped forever stops allocating once it reached its peak depth.
+
+**/
+
+#define RING_QUEUE_MIN_CAPACITY 64
+
+template <typename T>
+struct Ring_Queue {
+    T   *items    = NULL;
+    s64  capacity = 0; // Always 0 or a power of 2.
+    s64  head     = 0; // Index of the next pop, grows forever and is masked on access.
+    s64  tail     = 0; // Index of the next push.
+};
+
+typedef Ring_Queue<Task> Task_Queue;
+
+template <typename T>
+inline s64 ring_queue_size(Ring_Queue <T> *queue) {
+    return queue->tail - queue->head;
+}
+
+template <typename T>
+inline bool ring_queue_empty(Ring_Queue <T> *queue) {
+    return queue->tail == queue->head;
+}
+
+template <typename T>
+inline T *ring_queue_front(Ring_Queue <T> *queue) {
+    assert(!ring_queue_empty(queue));
+    return &queue->items[queue->head & (queue->capacity - 1)];
+}
+
+template <typename T>
+inline void ring_queue_grow(Ring_Queue <T> *queue) {
+    s64 new_capacity = queue->capacity ? queue->capacity * 2 : RING_QUEUE_MIN_CAPACITY;
+    T  *new_items    = new T[new_capacity];
+
+    s64 size = ring_queue_size(queue);
+    for (s64 i = 0; i < size; ++i) {
+        new_items[i] = std::move(queue->items[(queue->head + i) & (queue->capacity - 1)]);
+    }
+
+    delete[] queue->items;
+    queue->items    = new_items;
+    queue->capacity = new_capacity;
+    queue->head     = 0;
+    queue->tail     = size;
+}
+
+template <typename T>
+inline void ring_queue_push(Ring_Queue <T> *queue, T &&item) {
+    if (ring_queue_size(queue) == queue->capacity) { ring_queue_grow(queue); }
+    queue->items[queue->tail & (queue->capacity - 1)] = std::move(item);
+    queue->tail++;
+}
+
+template <typename T>
+inline bool ring_queue_pop(Ring_Queue <T> *queue, T *out) {
+    if (ring_queue_empty(queue)) { return false; }
+    *out = std::move(queue->items[queue->head & (queue->capacity - 1)]);
+    queue->head++;
+    return true;
+}
+
+template <typename T>
+inline void ring_queue_deinit(Ring_Queue <T> *queue) {
+    if (queue->items) {
+        delete[] queue->items;
+        queue->items = NULL;
+    }
+    queue->capacity = 0;
+    queue->head     = 0;
+    queue->tail     = 0;
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "Types.h"
+#include "Task.h"
+
+#include <assert.h>
+#include <chrono>
+#include <utility>
+
+/**
+
+   Priority levels and deadlines for Tasks. Not thread safe, the Thread_Pool holds its mutex around every call.
+
+   Each level keeps tasks without a deadline in a FIFO and tasks with one in a binary min heap ordered on the
+   deadline, so inside a level the earliest deadline always runs first and everything else runs in order.
+   Across levels the highest non empty level wins, except that a lower level whose oldest task has waited longer
+   than the starvation limit is served first. That keeps a steady stream of high priority work from shutting
+   out background jobs forever.
+
+   Every level tracks its depth and how long its tasks waited between being pushed and being popped.
+
+**/
+
+enum TASK_PRIORITY : u8 {
+    PRIORITY_HIGH   = 0,
+    PRIORITY_NORMAL = 1,
+    PRIORITY_LOW    = 2,
+    PRIORITY_COUNT  = 3,
+};
+
+#define NO_DEADLINE 0
+
+#ifndef TASK_STARVATION_LIMIT_MICROSECONDS
+#define TASK_STARVATION_LIMIT_MICROSECONDS 10000
+#endif
+
+#define DEADLINE_HEAP_MIN_CAPACITY 16
+
+// The clock deadlines are measured against, in nanoseconds.
+inline u64 task_clock_now() {
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Scheduled_Task {
+    Task task;
+    u64  enqueue_time = 0;
+    u64  deadline     = NO_DEADLINE;
+};
+
+struct Priority_Stats {
+    s64 depth;                  // Tasks waiting right now.
+    u64 submitted;
+    u64 dispatched;
+    u64 total_wait_nanoseconds; // Divide by dispatched for the mean.
+    u64 max_wait_nanoseconds;
+    u64 deadline_misses;        // Dispatched after their deadline had already passed.
+    u64 starvation_rescues;     // Dispatched ahead of a higher level because they had waited too long.
+};
+
+struct Priority_Level {
+    Ring_Queue <Scheduled_Task> fifo;
+
+    Scheduled_Task *deadlines         = NULL; // Min heap on deadline.
+    s64             deadline_count    = 0;
+    s64             deadline_capacity = 0;
+
+    Priority_Stats stats = {};
+};
+
+struct Task_Scheduler {
+    Priority_Level levels[PRIORITY_COUNT];
+    s64            size             = 0;
+    u64            starvation_limit = TASK_STARVATION_LIMIT_MICROSECONDS * 1000ull; // Nanoseconds.
+};
+
+//
+// Internal functions
+//
+inline void deadline_heap_push(Priority_Level *level, Scheduled_Task &&scheduled) {
+    if (level->deadline_count == level->deadline_capacity) {
+        s64 new_capacity = level->deadline_capacity ? level->deadline_capacity * 2 : DEADLINE_HEAP_MIN_CAPACITY;
+        auto *new_deadlines = new Scheduled_Task[new_capacity];
+        for (s64 i = 0; i < level->deadline_count; ++i) {
+            new_deadlines[i] = std::move(level->deadlines[i]);
+        }
+        delete[] level->deadlines;
+        level->deadlines         = new_deadlines;
+        level->deadline_capacity = new_capacity;
+    }
+
+    // Sift up, moving parents down into the hole instead of swapping.
+    s64 hole = level->deadline_count++;
+    while (hole > 0) {
+        s64 parent = (hole - 1) / 2;
+        if (level->deadlines[parent].deadline <= scheduled.deadline) { break; }
+        level->deadlines[hole] = std::move(level->deadlines[parent]);
+        hole = parent;
+    }
+    level->deadlines[hole] = std::move(scheduled);
+}
+
+inline void deadline_heap_pop(Priority_Level *level, Scheduled_Task *out) {
+    assert(level->deadline_count > 0);
+    *out = std::move(level->deadlines[0]);
+
+    s64 count = --level->deadline_count;
+    if (!count) { return; }
+
+    // Sift the last element down from the root.
+    Scheduled_Task last = std::move(level->deadlines[count]);
+    s64 hole = 0;
+    while (true) {
+        s64 child = 2 * hole + 1;
+        if (child >= count) { break; }
+        if (child + 1 < count && level->deadlines[child + 1].deadline < level->deadlines[child].deadline) { ++child; }
+        if (last.deadline <= level->deadlines[child].deadline) { break; }
+        level->deadlines[hole] = std::move(level->deadlines[child]);
+        hole = child;
+    }
+    level->deadlines[hole] = std::move(last);
+}
+
+inline s64 level_size(Priority_Level *level) {
+    return ring_queue_size(&level->fifo) + level->deadline_count;
+}
+
+// Enqueue time of the task at the front of the fifo or the top of the heap, whichever is older.
+inline u64 level_oldest(Priority_Level *level) {
+    u64 oldest = ~0ull;
+    if (!ring_queue_empty(&level->fifo)) { oldest = ring_queue_front(&level->fifo)->enqueue_time; }
+    if (level->deadline_count && level->deadlines[0].enqueue_time < oldest) { oldest = level->deadlines[0].enqueue_time; }
+    return oldest;
+}
+
+//
+// Interface
+//
+inline void scheduler_push(Task_Scheduler *scheduler, Task &task, TASK_PRIORITY priority, u64 deadline, u64 now) {
+    assert(priority < PRIORITY_COUNT);
+    Priority_Level *level = &scheduler->levels[priority];
+
+    Scheduled_Task scheduled;
+    scheduled.task         = std::move(task);
+    scheduled.enqueue_time = now;
+    scheduled.deadline     = deadline;
+
+    if (deadline == NO_DEADLINE) {
+        ring_queue_push(&level->fifo, std::move(scheduled));
+    } else {
+        deadline_heap_push(level, std::move(scheduled));
+    }
+
+    level->stats.submitted++;
+    scheduler->size++;
+}
+
+// Pops the most urgent task from levels up to and including 'lowest'. Starving tasks are returned no matter
+// which level they are on, 'popped' says which one it came from.
+inline bool scheduler_pop(Task_Scheduler *scheduler, u64 now, TASK_PRIORITY lowest, Task *out, TASK_PRIORITY *popped=NULL) {
+    if (!scheduler->size) { return false; }
+
+    s64 chosen = PRIORITY_COUNT;
+    for (s64 i = 0; i <= lowest; ++i) {
+        if (level_size(&scheduler->levels[i])) { chosen = i; break; }
+    }
+
+    // Anything below the chosen level that has waited past the limit goes first, the longest waiter wins.
+    s64 first_below  = (chosen < PRIORITY_COUNT) ? chosen + 1 : lowest + 1;
+    s64 rescued      = -1;
+    u64 longest_wait = scheduler->starvation_limit;
+    for (s64 i = first_below; i < PRIORITY_COUNT; ++i) {
+        Priority_Level *level = &scheduler->levels[i];
+        if (!level_size(level)) { continue; }
+        u64 oldest = level_oldest(level);
+        u64 wait   = (now > oldest) ? (now - oldest) : 0;
+        if (wait > longest_wait) { rescued = i; longest_wait = wait; }
+    }
+
+    if (rescued >= 0) {
+        chosen = rescued;
+        scheduler->levels[chosen].stats.starvation_rescues++;
+    }
+    if (chosen >= PRIORITY_COUNT) { return false; }
+
+    Priority_Level *level = &scheduler->levels[chosen];
+    Scheduled_Task  scheduled;
+    if (level->deadline_count) {
+        deadline_heap_pop(level, &scheduled);
+    } else {
+        ring_queue_pop(&level->fifo, &scheduled);
+    }
+
+    u64 wait = (now > scheduled.enqueue_time) ? (now - scheduled.enqueue_time) : 0;
+    level->stats.dispatched++;
+    level->stats.total_wait_nanoseconds += wait;
+    if (wait > level->stats.max_wait_nanoseconds) { level->stats.max_wait_nanoseconds = wait; }
+    if (scheduled.deadline != NO_DEADLINE && now > scheduled.deadline) { level->stats.deadline_misses++; }
+
+    scheduler->size--;
+    if (popped) { *popped = (TASK_PRIORITY)chosen; }
+    *out = std::move(scheduled.task);
+    return true;
+}
+
+inline Priority_Stats scheduler_stats(Task_Scheduler *scheduler, TASK_PRIORITY priority) {
+    Priority_Level *level = &scheduler->levels[priority];
+    Priority_Stats  stats = level->stats;
+    stats.depth = level_size(level);
+    return stats;
+}
+
+inline void scheduler_deinit(Task_Scheduler *scheduler) {
+    for (s64 i = 0; i < PRIORITY_COUNT; ++i) {
+        Priority_Level *level = &scheduler->levels[i];
+        ring_queue_deinit(&level->fifo);
+        if (level->deadlines) {
+            delete[] level->deadlines;
+            level->deadlines = NULL;
+        }
+        level->deadline_count    = 0;
+        level->deadline_capacity = 0;
+        level->stats             = {};
+    }
+    scheduler->size = 0;
+}
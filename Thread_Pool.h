@@ -1,47 +1,287 @@
 #pragma once
 
 #include "Types.h"
+#include "Task.h"
+#include "Task_Scheduler.h"
+#include "Work_Stealing_Deque.h"
+#include "Topology.h"
+#include "Sync.h"
 
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <vector> 
+#include <vector>
 #include <atomic>
-#include <queue>
-#include <functional>
+#include <utility>
+#include <chrono>
+#include <assert.h>
 
-struct Thread_Pool { 
-    std::condition_variable condition; 
+// Number of slots in each worker's local deque in WORK_STEALING mode. Must be a power of 2.
+// Anything pushed past this spills over into the worker's inbox.
+#ifndef THREAD_POOL_DEQUE_CAPACITY
+#define THREAD_POOL_DEQUE_CAPACITY 1024
+#endif
+
+enum THREAD_POOL_MODE : u8 {
+    GLOBAL_QUEUE  = 0, // One queue behind one mutex that every worker and submitter shares.
+    WORK_STEALING = 1, // One deque per worker, idle workers steal from a random victim.
+};
+
+// What a worker does when it runs out of work. It spins on pause for up to spin_microseconds, then yields its
+// time slice for up to yield_microseconds and only then parks on the condition variable. A task that arrives
+// during the first two phases is picked up without a futex wake or a context switch. Both zero parks straight
+// away, which is the cheapest on CPU time and the most expensive on latency.
+struct Thread_Pool_Idle_Policy {
+    s64 spin_microseconds  = 20;
+    s64 yield_microseconds = 100;
+};
+
+struct Thread_Pool_Stats {
+    u64 spin_wakeups;    // Work showed up while spinning.
+    u64 yield_wakeups;   // Work showed up while yielding.
+    u64 parks;           // Went to sleep on the condition variable.
+    u64 wakeups_avoided; // spin_wakeups + yield_wakeups, each one a futex wake and a context switch saved.
+
+    // Only covers tasks that went through the scheduler, see process_task.
+    Priority_Stats priorities[PRIORITY_COUNT];
+};
+
+struct Thread_Pool;
+
+struct Thread_Pool_Worker {
+    Thread_Pool *thread_pool;
+    s64          index;
+    u64          random_state; // xorshift state for picking victims.
+    s32          cpu  = -1;    // CPU this worker is pinned to, -1 if it isn't.
+    s32          node = -1;    // NUMA node of that CPU, -1 if unknown. Thieves try their own node first.
+
+    // Only this worker pushes and pops at the bottom, everyone else steals from the top.
+    Work_Stealing_Deque <Task> deque;
+
+    // Submissions from threads that aren't workers of this pool land here. Every worker has its own
+    // so submitters spread out over N locks instead of all fighting over one.
+    std::mutex       inbox_mutex;
+    Task_Queue       inbox;
+    std::atomic<s64> inbox_size {0}; // Lets thieves skip empty inboxes without locking.
+
+    // Idle counters. Only this worker writes them, they're atomic so get_stats can read them while it runs.
+    std::atomic<u64> spin_wakeups  {0};
+    std::atomic<u64> yield_wakeups {0};
+    std::atomic<u64> parks         {0};
+
+    u64 dispatches = 0; // Tasks this worker has picked up, paces the scheduler checks in get_task.
+};
+
+struct Thread_Pool {
+    std::condition_variable condition;
     std::atomic<bool> thread_pool_active;
-    std::queue<std::function<void()>> function_queue;
     std::mutex mutex;
 
+    // Guarded by mutex. Holds every task in GLOBAL_QUEUE mode and only the prioritized ones in WORK_STEALING.
+    // The counts mirror it so workers can look without locking.
+    Task_Scheduler   scheduler;
+    std::atomic<s64> scheduled_tasks;
+    std::atomic<s64> urgent_tasks;    // Scheduled at PRIORITY_NORMAL or higher.
+
     std::vector<std::thread> threads;
     s64 number_of_threads;
+
+    THREAD_POOL_MODE        mode;
+    Thread_Pool_Idle_Policy idle_policy;
+
+    Thread_Pool_Worker *workers;
+    std::atomic<s64>    pending_tasks;    // Submitted but not yet picked up, idle workers spin on this.
+    std::atomic<s64>    sleeping_workers; // Submitters only notify when this is non zero.
+    std::atomic<s64>    workers_ready;    // Workers that have pinned themselves and set up their deque.
+
+    // WORK_STEALING only. The mutex and condition above are then only used for parking idle workers.
+    std::atomic<u64>    next_worker;      // Round robin target for outside submissions.
 };
 
-void thread_function(Thread_Pool *thread_pool) { 
-    std::function<void()> function;
+// The worker the current thread is running as, NULL for threads outside any pool.
+inline thread_local Thread_Pool_Worker *current_thread_pool_worker = NULL;
+
+inline u64 worker_next_random(Thread_Pool_Worker *worker) {
+    u64 x = worker->random_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    worker->random_state = x;
+    return x;
+}
+
+inline bool inbox_pop(Thread_Pool_Worker *worker, Task *out) {
+    if (worker->inbox_size.load(std::memory_order_relaxed) <= 0) { return false; }
+
+    std::unique_lock<std::mutex> lock(worker->inbox_mutex);
+    if (!ring_queue_pop(&worker->inbox, out)) { return false; }
+
+    worker->inbox_size.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+inline void inbox_push(Thread_Pool_Worker *worker, Task *tasks, s64 count) {
+    std::unique_lock<std::mutex> lock(worker->inbox_mutex);
+    for (s64 i = 0; i < count; ++i) {
+        ring_queue_push(&worker->inbox, std::move(tasks[i]));
+    }
+    worker->inbox_size.fetch_add(count, std::memory_order_relaxed);
+}
+
+// Visits every worker but 'thief' once, starting at 'start'. thief is NULL for threads outside the pool.
+// A pinned thief goes round the workers on its own NUMA node first so the tasks, and whatever memory they
+// touch, stay local as long as there is local work to take.
+inline bool steal_task(Thread_Pool *thread_pool, Thread_Pool_Worker *thief, u64 start, Task *out) {
+    s32  node   = thief ? thief->node : -1;
+    s64  passes = (node >= 0) ? 2 : 1;
+
+    for (s64 pass = 0; pass < passes; ++pass) {
+        for (s64 i = 0; i < thread_pool->number_of_threads; ++i) {
+            Thread_Pool_Worker *victim = &thread_pool->workers[(start + i) % (u64)thread_pool->number_of_threads];
+            if (victim == thief) { continue; }
+            if (passes == 2 && (victim->node == node) != (pass == 0)) { continue; }
+            if (deque_steal(&victim->deque, out) || inbox_pop(victim, out)) { return true; }
+        }
+    }
+    return false;
+}
+
+// Own deque first, then own inbox, then go stealing starting at a random victim.
+inline bool find_task(Thread_Pool_Worker *worker, Task *out) {
+    Thread_Pool *thread_pool = worker->thread_pool;
+
+    bool found = deque_pop(&worker->deque, out) || inbox_pop(worker, out);
+
+    if (!found && thread_pool->number_of_threads > 1) {
+        found = steal_task(thread_pool, worker, worker_next_random(worker), out);
+    }
+
+    if (found) { thread_pool->pending_tasks.fetch_sub(1, std::memory_order_seq_cst); }
+    return found;
+}
+
+// How often a WORK_STEALING worker looks at the scheduler when nothing urgent is in it, so starving low
+// priority tasks still get rescued while the deques are busy.
+#define SCHEDULER_CHECK_INTERVAL 64
+
+// Caller holds thread_pool->mutex.
+inline void schedule_task(Thread_Pool *thread_pool, Task &task, TASK_PRIORITY priority, u64 deadline, u64 now) {
+    scheduler_push(&thread_pool->scheduler, task, priority, deadline, now);
+    thread_pool->scheduled_tasks.fetch_add(1, std::memory_order_relaxed);
+    if (priority <= PRIORITY_NORMAL) { thread_pool->urgent_tasks.fetch_add(1, std::memory_order_relaxed); }
+    thread_pool->pending_tasks.fetch_add(1, std::memory_order_seq_cst);
+}
+
+inline bool take_scheduled_task(Thread_Pool *thread_pool, TASK_PRIORITY lowest, Task *out) {
+    std::unique_lock<std::mutex> lock(thread_pool->mutex);
+
+    TASK_PRIORITY priority;
+    if (!scheduler_pop(&thread_pool->scheduler, task_clock_now(), lowest, out, &priority)) { return false; }
+
+    thread_pool->scheduled_tasks.fetch_sub(1, std::memory_order_relaxed);
+    if (priority <= PRIORITY_NORMAL) { thread_pool->urgent_tasks.fetch_sub(1, std::memory_order_relaxed); }
+    thread_pool->pending_tasks.fetch_sub(1, std::memory_order_seq_cst);
+    return true;
+}
+
+inline bool get_task(Thread_Pool_Worker *worker, Task *out) {
+    Thread_Pool *thread_pool = worker->thread_pool;
+    if (thread_pool->mode != WORK_STEALING) { return take_scheduled_task(thread_pool, PRIORITY_LOW, out); }
+
+    // High priority and deadline tasks jump ahead of the deques, low priority ones wait until the deques are dry
+    // unless they've been waiting long enough to be rescued.
+    bool periodic = (++worker->dispatches % SCHEDULER_CHECK_INTERVAL) == 0;
+    if (thread_pool->urgent_tasks.load(std::memory_order_relaxed) > 0 || (periodic && thread_pool->scheduled_tasks.load(std::memory_order_relaxed) > 0)) {
+        if (take_scheduled_task(thread_pool, PRIORITY_NORMAL, out)) { return true; }
+    }
+
+    if (find_task(worker, out)) { return true; }
+
+    return thread_pool->scheduled_tasks.load(std::memory_order_relaxed) > 0 && take_scheduled_task(thread_pool, PRIORITY_LOW, out);
+}
+
+inline bool worker_should_wake(Thread_Pool *thread_pool) {
+    return thread_pool->pending_tasks.load(std::memory_order_seq_cst) > 0 || !thread_pool->thread_pool_active.load(std::memory_order_seq_cst);
+}
+
+// Returns once there is probably something to do or the pool is shutting down, see Thread_Pool_Idle_Policy.
+inline void worker_idle(Thread_Pool_Worker *worker) {
+    Thread_Pool *thread_pool = worker->thread_pool;
+    const s64 CHECKS_PER_CLOCK_READ = 64; // Reading the clock costs more than a pause, don't do it every time.
+
+    auto start = std::chrono::steady_clock::now();
+    auto spin_until  = start + std::chrono::microseconds(thread_pool->idle_policy.spin_microseconds);
+    auto yield_until = spin_until + std::chrono::microseconds(thread_pool->idle_policy.yield_microseconds);
+
+    if (thread_pool->idle_policy.spin_microseconds > 0) {
+        while (true) {
+            for (s64 i = 0; i < CHECKS_PER_CLOCK_READ; ++i) {
+                if (worker_should_wake(thread_pool)) {
+                    worker->spin_wakeups.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                cpu_pause();
+            }
+            if (std::chrono::steady_clock::now() >= spin_until) { break; }
+        }
+    }
+
+    if (thread_pool->idle_policy.yield_microseconds > 0) {
+        while (true) {
+            // Checked once more after the last yield, we may have been descheduled for a lot longer than asked.
+            if (worker_should_wake(thread_pool)) {
+                worker->yield_wakeups.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (std::chrono::steady_clock::now() >= yield_until) { break; }
+            std::this_thread::yield();
+        }
+    }
+
+    // Park. sleeping_workers is published before we look at pending_tasks and submitters bump pending_tasks
+    // before they look at sleeping_workers, so at least one side always sees the other and a wakeup can't be lost.
+    std::unique_lock<std::mutex> lock(thread_pool->mutex);
+    thread_pool->sleeping_workers.fetch_add(1, std::memory_order_seq_cst);
+    if (!worker_should_wake(thread_pool)) {
+        worker->parks.fetch_add(1, std::memory_order_relaxed);
+        thread_pool->condition.wait(lock, [thread_pool]() { return worker_should_wake(thread_pool); });
+    }
+    thread_pool->sleeping_workers.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+inline void thread_function(Thread_Pool_Worker *worker) {
+    Thread_Pool *thread_pool = worker->thread_pool;
+    current_thread_pool_worker = worker;
+
+    // Pin before allocating anything so first touch puts the deque on this worker's NUMA node.
+    if (worker->cpu >= 0) { pin_current_thread(worker->cpu); }
+    if (thread_pool->mode == WORK_STEALING) { deque_init(&worker->deque, THREAD_POOL_DEQUE_CAPACITY); }
+
+    // Nobody steals until every deque exists.
+    thread_pool->workers_ready.fetch_add(1, std::memory_order_seq_cst);
+    while (thread_pool->workers_ready.load(std::memory_order_seq_cst) < thread_pool->number_of_threads) { std::this_thread::yield(); }
+
+    Task function;
 
     while (true) {
-        std::unique_lock<std::mutex> lock(thread_pool->mutex);
-        thread_pool->condition.wait(lock, [thread_pool]() {
-                return !thread_pool->function_queue.empty() || !thread_pool->thread_pool_active.load(std::memory_order_seq_cst);
-            });
+        if (get_task(worker, &function)) {
+            function();
+            function = nullptr; // Release captures now rather than whenever the next task overwrites them.
+            continue;
+        }
 
-        // If the thread pool is marked !active or inactive and the function queue is empty then we're done.
-        if (!thread_pool->thread_pool_active.load(std::memory_order_seq_cst) && thread_pool->function_queue.empty()) { return; }
+        // If the thread pool is marked inactive and nothing is queued then we're done.
+        if (!thread_pool->thread_pool_active.load(std::memory_order_seq_cst) && thread_pool->pending_tasks.load(std::memory_order_seq_cst) <= 0) { return; }
 
-        // Pop the function off the queue and execute it.
-        function = thread_pool->function_queue.front(); 
-        thread_pool->function_queue.pop();
-        function();
+        worker_idle(worker);
     }
 }
 
-void init(Thread_Pool *thread_pool, u64 number_of_threads) {
+// pin_policy places worker i on the i'th CPU of the order Topology.h derives from it, wrapping around if there
+// are more workers than CPUs. PIN_NONE leaves placement to the OS.
+inline void init(Thread_Pool *thread_pool, u64 number_of_threads, THREAD_POOL_MODE mode=GLOBAL_QUEUE, Thread_Pool_Idle_Policy idle_policy=Thread_Pool_Idle_Policy(), Pin_Policy pin_policy=Pin_Policy()) {
     const s64 max_threads = std::thread::hardware_concurrency();
-    // Cap the number of threads in the pool to the max reported by 
+    // Cap the number of threads in the pool to the max reported by
     if (number_of_threads > max_threads) { number_of_threads = max_threads; }
 
     // Protected against 0 threads
@@ -49,27 +289,435 @@ void init(Thread_Pool *thread_pool, u64 number_of_threads) {
 
     thread_pool->number_of_threads = number_of_threads;
     thread_pool->threads.reserve(thread_pool->number_of_threads);
+    thread_pool->mode = mode;
+    thread_pool->idle_policy = idle_policy;
 
-    for (s64 i = 0; i < thread_pool->number_of_threads; ++i) { 
-        thread_pool->threads.push_back(std::thread(&thread_function, thread_pool)); 
-    }
+    thread_pool->next_worker.store(0, std::memory_order_relaxed);
+    thread_pool->pending_tasks.store(0, std::memory_order_relaxed);
+    thread_pool->sleeping_workers.store(0, std::memory_order_relaxed);
+    thread_pool->scheduled_tasks.store(0, std::memory_order_relaxed);
+    thread_pool->urgent_tasks.store(0, std::memory_order_relaxed);
+    thread_pool->workers_ready.store(0, std::memory_order_relaxed);
 
+    // Has to be set before the threads start or they see an inactive empty pool and exit straight away.
     thread_pool->thread_pool_active.store(true, std::memory_order_seq_cst);
+
+    thread_pool->workers = new Thread_Pool_Worker[thread_pool->number_of_threads];
+    for (s64 i = 0; i < thread_pool->number_of_threads; ++i) {
+        Thread_Pool_Worker *worker = &thread_pool->workers[i];
+        worker->thread_pool  = thread_pool;
+        worker->index        = i;
+        worker->random_state = 0x9e3779b97f4a7c15ull * (u64)(i + 1); // Never 0 or xorshift gets stuck.
+    }
+
+    if (pin_policy.policy != PIN_NONE) {
+        Cpu_Topology topology;
+        topology_init(&topology);
+
+        s32 order[MAX_TOPOLOGY_CPUS];
+        s32 count = topology_pin_order(&topology, pin_policy, order, MAX_TOPOLOGY_CPUS);
+        for (s64 i = 0; count > 0 && i < thread_pool->number_of_threads; ++i) {
+            Thread_Pool_Worker *worker = &thread_pool->workers[i];
+            worker->cpu  = order[i % count];
+            worker->node = (topology.node_count > 1) ? topology_node_of(&topology, worker->cpu) : -1;
+        }
+
+        topology_deinit(&topology);
+    }
+
+    for (s64 i = 0; i < thread_pool->number_of_threads; ++i) {
+        thread_pool->threads.push_back(std::thread(&thread_function, &thread_pool->workers[i]));
+    }
+
+    // Workers set up their own deques, don't hand out tasks before they have.
+    while (thread_pool->workers_ready.load(std::memory_order_seq_cst) < thread_pool->number_of_threads) { std::this_thread::yield(); }
+}
+
+
+inline void process_task(Thread_Pool *thread_pool, Task &task) {
+    if (thread_pool->mode == WORK_STEALING) {
+        // Counted before it becomes visible so pending_tasks never goes negative.
+        thread_pool->pending_tasks.fetch_add(1, std::memory_order_seq_cst);
+
+        // Workers of this pool push onto their own deque without any locking. Everyone else, or a worker whose
+        // deque is full, goes through an inbox picked round robin.
+        Thread_Pool_Worker *worker = current_thread_pool_worker;
+        if (!worker || worker->thread_pool != thread_pool || !deque_push(&worker->deque, task)) {
+            u64 target = thread_pool->next_worker.fetch_add(1, std::memory_order_relaxed) % (u64)thread_pool->number_of_threads;
+            inbox_push(&thread_pool->workers[target], &task, 1);
+        }
+
+        if (thread_pool->sleeping_workers.load(std::memory_order_seq_cst) > 0) {
+            std::unique_lock<std::mutex> lock(thread_pool->mutex);
+            thread_pool->condition.notify_one();
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(thread_pool->mutex);
+    schedule_task(thread_pool, task, PRIORITY_NORMAL, NO_DEADLINE, task_clock_now());
+    if (thread_pool->sleeping_workers.load(std::memory_order_seq_cst) > 0) { thread_pool->condition.notify_one(); }
+}
+
+// Submits through the scheduler, see Task_Scheduler.h. In WORK_STEALING mode a PRIORITY_NORMAL task without a
+// deadline takes the lock free deque path instead, so it doesn't show up in the priority stats.
+inline void process_task(Thread_Pool *thread_pool, Task &task, TASK_PRIORITY priority, u64 deadline=NO_DEADLINE) {
+    if (thread_pool->mode == WORK_STEALING && priority == PRIORITY_NORMAL && deadline == NO_DEADLINE) {
+        process_task(thread_pool, task);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(thread_pool->mutex);
+    schedule_task(thread_pool, task, priority, deadline, task_clock_now());
+    if (thread_pool->sleeping_workers.load(std::memory_order_seq_cst) > 0) { thread_pool->condition.notify_one(); }
 }
 
+// Takes any void() callable, including a std::function. The callable is moved into an inline Task so neither
+// submission nor dispatch touches the heap.
+template <typename Function>
+void process(Thread_Pool *thread_pool, Function &&function) {
+    Task task(std::forward<Function>(function));
+    process_task(thread_pool, task);
+}
 
-void process(Thread_Pool *thread_pool, std::function<void()> function) { 
-    std::unique_lock<std::mutex> lock(thread_pool->mutex); 
-    thread_pool->function_queue.push(function);
-    thread_pool->condition.notify_one();
+// deadline is on task_clock_now(), e.g. task_clock_now() + 2000000 for two milliseconds from now.
+template <typename Function>
+void process(Thread_Pool *thread_pool, Function &&function, TASK_PRIORITY priority, u64 deadline=NO_DEADLINE) {
+    Task task(std::forward<Function>(function));
+    process_task(thread_pool, task, priority, deadline);
 }
 
-void deinit(Thread_Pool *thread_pool) { 
-    thread_pool->thread_pool_active.store(false, std::memory_order_seq_cst);
-    thread_pool->condition.notify_all();
-    for (s64 i = 0; i < thread_pool->number_of_threads; ++i) { 
-        if (thread_pool->threads[i].joinable()) { 
+inline void deinit(Thread_Pool *thread_pool) {
+    {
+        // Taken so a worker can't check the predicate, miss the store and then sleep through the notify.
+        std::unique_lock<std::mutex> lock(thread_pool->mutex);
+        thread_pool->thread_pool_active.store(false, std::memory_order_seq_cst);
+        thread_pool->condition.notify_all();
+    }
+
+    for (s64 i = 0; i < thread_pool->number_of_threads; ++i) {
+        if (thread_pool->threads[i].joinable()) {
             thread_pool->threads[i].join();
         }
     }
+    thread_pool->threads.clear();
+
+    if (thread_pool->workers) {
+        for (s64 i = 0; i < thread_pool->number_of_threads; ++i) {
+            deque_deinit(&thread_pool->workers[i].deque);
+        }
+        for (s64 i = 0; i < thread_pool->number_of_threads; ++i) {
+            ring_queue_deinit(&thread_pool->workers[i].inbox);
+        }
+        delete[] thread_pool->workers;
+        thread_pool->workers = NULL;
+    }
+
+    scheduler_deinit(&thread_pool->scheduler);
+}
+
+inline Thread_Pool_Stats get_stats(Thread_Pool *thread_pool) {
+    Thread_Pool_Stats stats = {};
+    if (!thread_pool->workers) { return stats; }
+
+    for (s64 i = 0; i < thread_pool->number_of_threads; ++i) {
+        Thread_Pool_Worker *worker = &thread_pool->workers[i];
+        stats.spin_wakeups  += worker->spin_wakeups.load(std::memory_order_relaxed);
+        stats.yield_wakeups += worker->yield_wakeups.load(std::memory_order_relaxed);
+        stats.parks         += worker->parks.load(std::memory_order_relaxed);
+    }
+    stats.wakeups_avoided = stats.spin_wakeups + stats.yield_wakeups;
+
+    std::unique_lock<std::mutex> lock(thread_pool->mutex);
+    for (s64 i = 0; i < PRIORITY_COUNT; ++i) {
+        stats.priorities[i] = scheduler_stats(&thread_pool->scheduler, (TASK_PRIORITY)i);
+    }
+    return stats;
+}
+
+// Submits count tasks with one lock round trip and one broadcast instead of one of each per task.
+// The tasks are moved out of the array.
+inline void process_batch(Thread_Pool *thread_pool, Task *tasks, s64 count) {
+    if (count <= 0) { return; }
+
+    if (thread_pool->mode == WORK_STEALING) {
+        thread_pool->pending_tasks.fetch_add(count, std::memory_order_seq_cst);
+
+        // A worker keeps as much as fits on its own deque and lets the others steal it.
+        s64 submitted = 0;
+        Thread_Pool_Worker *worker = current_thread_pool_worker;
+        if (worker && worker->thread_pool == thread_pool) {
+            while (submitted < count && deque_push(&worker->deque, tasks[submitted])) { ++submitted; }
+        }
+
+        // Whatever is left is dealt out in contiguous runs, so it's at most one inbox lock per worker.
+        s64 number_of_threads = thread_pool->number_of_threads;
+        s64 run               = (count - submitted + number_of_threads - 1) / number_of_threads;
+        u64 start             = thread_pool->next_worker.fetch_add(1, std::memory_order_relaxed);
+        for (s64 i = 0; submitted < count; ++i) {
+            s64 n = (count - submitted < run) ? (count - submitted) : run;
+            inbox_push(&thread_pool->workers[(start + i) % (u64)number_of_threads], tasks + submitted, n);
+            submitted += n;
+        }
+
+        if (thread_pool->sleeping_workers.load(std::memory_order_seq_cst) > 0) {
+            std::unique_lock<std::mutex> lock(thread_pool->mutex);
+            thread_pool->condition.notify_all();
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(thread_pool->mutex);
+    u64 now = task_clock_now();
+    for (s64 i = 0; i < count; ++i) {
+        schedule_task(thread_pool, tasks[i], PRIORITY_NORMAL, NO_DEADLINE, now);
+    }
+    if (thread_pool->sleeping_workers.load(std::memory_order_seq_cst) > 0) { thread_pool->condition.notify_all(); }
+}
+
+
+// Runs one queued task on the calling thread if there is one. Used by anything that waits on the pool so the
+// waiting thread does useful work instead of blocking, which also means waiting from inside a task can't
+// deadlock a pool whose workers are all waiting.
+inline bool try_run_task(Thread_Pool *thread_pool) {
+    Task task;
+    bool found = false;
+
+    if (thread_pool->mode == WORK_STEALING) {
+        Thread_Pool_Worker *worker = current_thread_pool_worker;
+        if (worker && worker->thread_pool == thread_pool) {
+            found = get_task(worker, &task);
+        } else {
+            u64 start = thread_pool->next_worker.fetch_add(1, std::memory_order_relaxed);
+            found = steal_task(thread_pool, NULL, start, &task);
+            if (found) { thread_pool->pending_tasks.fetch_sub(1, std::memory_order_seq_cst); }
+            if (!found && thread_pool->scheduled_tasks.load(std::memory_order_relaxed) > 0) {
+                found = take_scheduled_task(thread_pool, PRIORITY_LOW, &task);
+            }
+        }
+    } else {
+        found = take_scheduled_task(thread_pool, PRIORITY_LOW, &task);
+    }
+
+    if (found) { task(); }
+    return found;
+}
+
+
+/**
+
+   A Task_Group counts the tasks submitted through it that haven't finished yet.
+
+       Task_Group group;
+       for (...) { process(&thread_pool, function, &group); }
+       then(&thread_pool, &group, merge_results);   // Queued once every task in the group has finished.
+       wait(&thread_pool, &group);                  // Runs other queued tasks while it waits.
+       deinit(&group);
+
+   A group can be reused once it is done. Continuations fire every time the count drops to zero. then() can
+   count its continuation in another group, which is how you chain stages and wait on the end of the chain.
+
+**/
+
+struct Task_Group {
+    // Pending tasks times 2. The low bit is a lock over the continuations, sharing the word means the last
+    // task can release the lock and mark the group done in one store, after which it never touches the group
+    // again. A waiter is free to destroy the group as soon as it sees it done.
+    std::atomic<s64> state {0};
+
+    // Continuations waiting for the group to be done and the pool they get submitted to.
+    Task_Queue   continuations;
+    Thread_Pool *thread_pool = NULL;
+};
+
+inline bool is_done(Task_Group *group) {
+    return (group->state.load(std::memory_order_acquire) >> 1) == 0;
+}
+
+// Returns the state as it was before we locked it.
+inline s64 task_group_lock(Task_Group *group) {
+    s64 state = group->state.load(std::memory_order_relaxed);
+    while (true) {
+        if (state & 1) {
+            cpu_pause();
+            state = group->state.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (group->state.compare_exchange_weak(state, state | 1, std::memory_order_acquire, std::memory_order_relaxed)) { return state; }
+    }
+}
+
+inline void task_group_finish(Task_Group *group) {
+    s64 state = group->state.load(std::memory_order_relaxed);
+    while ((state >> 1) > 1) { // Not the last one, just count down.
+        if (group->state.compare_exchange_weak(state, state - 2, std::memory_order_acq_rel, std::memory_order_relaxed)) { return; }
+    }
+
+    // Last one out takes the continuations under the lock so then() can't append in between, then drops the
+    // count and the lock together.
+    task_group_lock(group);
+    Task_Queue   continuations = group->continuations;
+    Thread_Pool *thread_pool   = group->thread_pool;
+    group->continuations = Task_Queue{};
+    group->state.fetch_sub(3, std::memory_order_acq_rel);
+
+    Task task;
+    while (ring_queue_pop(&continuations, &task)) {
+        process_task(thread_pool, task);
+    }
+    ring_queue_deinit(&continuations);
+}
+
+template <typename Function>
+void process(Thread_Pool *thread_pool, Function &&function, Task_Group *group) {
+    group->state.fetch_add(2, std::memory_order_relaxed);
+    process(thread_pool, [group, function = std::forward<Function>(function)]() mutable {
+            function();
+            task_group_finish(group);
+        });
+}
+
+// Queues function on thread_pool once group is done, straight away if it already is.
+// If next is given the continuation counts as one of its tasks.
+template <typename Function>
+void then(Thread_Pool *thread_pool, Task_Group *group, Function &&function, Task_Group *next=NULL) {
+    Task task;
+    if (next) {
+        next->state.fetch_add(2, std::memory_order_relaxed);
+        task = Task([next, function = std::forward<Function>(function)]() mutable {
+                function();
+                task_group_finish(next);
+            });
+    } else {
+        task = Task(std::forward<Function>(function));
+    }
+
+    s64 state = task_group_lock(group);
+    if ((state >> 1) > 0) {
+        group->thread_pool = thread_pool;
+        ring_queue_push(&group->continuations, std::move(task));
+        group->state.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    group->state.fetch_sub(1, std::memory_order_release);
+
+    process_task(thread_pool, task);
+}
+
+// Helps out with queued tasks until every task in the group has finished.
+inline void wait(Thread_Pool *thread_pool, Task_Group *group) {
+    while (!is_done(group)) {
+        if (!try_run_task(thread_pool)) { std::this_thread::yield(); }
+    }
+}
+
+inline void deinit(Task_Group *group) {
+    assert(is_done(group));
+    ring_queue_deinit(&group->continuations);
+}
+
+/**
+
+   parallel_for(thread_pool, begin, end, grain, function) calls function(i) for every i in [begin, end) and
+   returns once all of them have run. function is called concurrently from several threads.
+
+   The calling thread works on the range too, so this is safe to call from inside a task, even on a pool with a
+   single worker. Chunks are claimed off a shared counter and shrink as the range drains (guided scheduling):
+   early claims are large so there are few of them, later claims are small so the participants finish at
+   roughly the same time. A chunk is never smaller than grain.
+
+   The shared state is reference counted because helper tasks can still be sitting in a queue after the range
+   is finished. Those find nothing left to claim and never touch function.
+
+**/
+
+template <typename Function>
+struct Parallel_For_State {
+    alignas(64) std::atomic<s64> next;      // First index nobody has claimed yet.
+    alignas(64) std::atomic<s64> completed; // Number of indices that have finished running.
+    std::atomic<s64> references;
+
+    s64 end;
+    s64 grain;
+    s64 participants;
+    Function *function;
+};
+
+template <typename Function>
+void parallel_for_work(Parallel_For_State <Function> *state) {
+    while (true) {
+        s64 start = state->next.load(std::memory_order_relaxed);
+        s64 chunk = 0;
+        do {
+            s64 remaining = state->end - start;
+            if (remaining <= 0) { return; }
+
+            chunk = remaining / (2 * state->participants);
+            if (chunk < state->grain) { chunk = state->grain; }
+            if (chunk > remaining)    { chunk = remaining; }
+        } while (!state->next.compare_exchange_weak(start, start + chunk, std::memory_order_relaxed));
+
+        for (s64 i = start; i < start + chunk; ++i) {
+            (*state->function)(i);
+        }
+
+        state->completed.fetch_add(chunk, std::memory_order_release);
+    }
+}
+
+template <typename Function>
+void parallel_for_release(Parallel_For_State <Function> *state) {
+    if (state->references.fetch_sub(1, std::memory_order_acq_rel) == 1) { delete state; }
+}
+
+template <typename Function>
+void parallel_for(Thread_Pool *thread_pool, s64 begin, s64 end, s64 grain, Function &&function) {
+    if (end <= begin) { return; }
+    if (grain < 1)    { grain = 1; }
+
+    s64 total  = end - begin;
+    s64 chunks = (total + grain - 1) / grain;
+
+    // Not worth waking anybody for a single chunk.
+    s64 helpers = thread_pool->number_of_threads;
+    if (helpers > chunks - 1) { helpers = chunks - 1; }
+    if (helpers <= 0) {
+        for (s64 i = begin; i < end; ++i) { function(i); }
+        return;
+    }
+
+    typedef typename std::remove_reference<Function>::type Callable;
+    auto *state = new Parallel_For_State <Callable>;
+    state->next.store(begin, std::memory_order_relaxed);
+    state->completed.store(0, std::memory_order_relaxed);
+    state->references.store(helpers + 1, std::memory_order_relaxed);
+    state->end          = end;
+    state->grain        = grain;
+    state->participants = helpers + 1;
+    state->function     = &function;
+
+    const s64 MAX_HELPERS_ON_STACK = 64;
+    Task helper_tasks[MAX_HELPERS_ON_STACK];
+    s64 submitted = 0;
+    while (submitted < helpers) {
+        s64 n = helpers - submitted;
+        if (n > MAX_HELPERS_ON_STACK) { n = MAX_HELPERS_ON_STACK; }
+        for (s64 i = 0; i < n; ++i) {
+            helper_tasks[i] = Task([state]() {
+                    parallel_for_work(state);
+                    parallel_for_release(state);
+                });
+        }
+        process_batch(thread_pool, helper_tasks, n);
+        submitted += n;
+    }
+
+    parallel_for_work(state);
+
+    // Everything is claimed, wait for the chunks other threads are still running.
+    while (state->completed.load(std::memory_order_acquire) < total) {
+        if (!try_run_task(thread_pool)) { std::this_thread::yield(); }
+    }
+
+    parallel_for_release(state);
 }
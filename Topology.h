@@ -0,0 +1,289 @@
+#pragma once
+
+#include "Types.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+
+   CPU topology and thread pinning.
+
+   On linux the topology comes straight out of /sys so there is no dependency on libnuma:
+
+       /sys/devices/system/cpu/online                            which CPUs exist
+       /sys/devices/system/cpu/cpuN/topology/physical_package_id which socket a CPU is on
+       /sys/devices/system/cpu/cpuN/topology/core_id             which physical core inside the socket
+       /sys/devices/system/node/nodeK/cpulist                    which CPUs belong to NUMA node K
+
+   Anywhere else, or if /sys can't be read, every CPU is its own core on socket 0 and node 0.
+
+   Pin policies turn the topology into an order to hand CPUs out in:
+
+       PIN_COMPACT  fill a node before moving to the next one, and both hyperthreads of a core before the
+                    next core. Threads that share data share caches.
+       PIN_SCATTER  one thread per node in turn, and one per physical core before doubling up on hyperthreads.
+                    Threads that need bandwidth get as many memory controllers and L2s as possible.
+       PIN_EXPLICIT use the CPUs in the given list, in that order.
+
+**/
+
+#define MAX_TOPOLOGY_CPUS 1024
+
+enum PIN_POLICY : u8 {
+    PIN_NONE     = 0,
+    PIN_COMPACT  = 1,
+    PIN_SCATTER  = 2,
+    PIN_EXPLICIT = 3,
+};
+
+struct Pin_Policy {
+    PIN_POLICY policy    = PIN_NONE;
+    const s32 *cpus      = NULL; // PIN_EXPLICIT only.
+    s32        cpu_count = 0;
+};
+
+struct Cpu_Info {
+    s32 cpu;
+    s32 package;
+    s32 core;
+    s32 node;
+    s32 sibling; // 0 for the first hyperthread of a core, 1 for the second and so on.
+};
+
+struct Cpu_Topology {
+    Cpu_Info *cpus       = NULL;
+    s32       cpu_count  = 0;
+    s32       node_count = 0;
+};
+
+//
+// Internal functions
+//
+
+// Parses the kernel's cpulist format, e.g. "0-3,8-11\n". Returns the number of CPUs written to out.
+inline s32 parse_cpu_list(const char *text, s32 *out, s32 max) {
+    s32 count = 0;
+    const char *at = text;
+    while (*at && *at != '\n') {
+        char *end   = NULL;
+        long  first = strtol(at, &end, 10);
+        if (end == at) { break; }
+        long last = first;
+        at = end;
+        if (*at == '-') {
+            last = strtol(at + 1, &end, 10);
+            at   = end;
+        }
+        for (long cpu = first; cpu <= last && count < max; ++cpu) { out[count++] = (s32)cpu; }
+        if (*at == ',') { ++at; }
+    }
+    return count;
+}
+
+inline bool read_sys_file(const char *path, char *buffer, s32 size) {
+    FILE *file = fopen(path, "r");
+    if (!file) { return false; }
+    bool ok = fgets(buffer, size, file) != NULL;
+    fclose(file);
+    return ok;
+}
+
+inline s32 read_sys_integer(const char *path, s32 fallback) {
+    char buffer[64];
+    if (!read_sys_file(path, buffer, sizeof(buffer))) { return fallback; }
+    return (s32)strtol(buffer, NULL, 10);
+}
+
+inline s32 topology_find(Cpu_Topology *topology, s32 cpu) {
+    for (s32 i = 0; i < topology->cpu_count; ++i) {
+        if (topology->cpus[i].cpu == cpu) { return i; }
+    }
+    return -1;
+}
+
+//
+// Interface
+//
+inline void topology_init(Cpu_Topology *topology) {
+    s32 cpu_ids[MAX_TOPOLOGY_CPUS];
+    s32 count = 0;
+
+#if defined(__linux__)
+    char buffer[4096];
+    if (read_sys_file("/sys/devices/system/cpu/online", buffer, sizeof(buffer))) {
+        count = parse_cpu_list(buffer, cpu_ids, MAX_TOPOLOGY_CPUS);
+    }
+#endif
+
+    if (!count) {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        count = (s32)info.dwNumberOfProcessors;
+#endif
+#if defined(__linux__)
+        count = (s32)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (count < 1)                 { count = 1; }
+        if (count > MAX_TOPOLOGY_CPUS) { count = MAX_TOPOLOGY_CPUS; }
+        for (s32 i = 0; i < count; ++i) { cpu_ids[i] = i; }
+    }
+
+    topology->cpus       = (Cpu_Info *)calloc(count, sizeof(Cpu_Info));
+    topology->cpu_count  = count;
+    topology->node_count = 1;
+
+    for (s32 i = 0; i < count; ++i) {
+        Cpu_Info *info = &topology->cpus[i];
+        info->cpu     = cpu_ids[i];
+        info->package = 0;
+        info->core    = cpu_ids[i];
+        info->node    = 0;
+
+#if defined(__linux__)
+        char path[256];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", info->cpu);
+        info->package = read_sys_integer(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", info->cpu);
+        info->core = read_sys_integer(path, info->cpu);
+#endif
+    }
+
+#if defined(__linux__)
+    // Node directories can have holes in their numbering, keep looking until we've placed every CPU.
+    s32 placed = 0;
+    s32 misses = 0;
+    for (s32 node = 0; placed < count && misses < 64; ++node) {
+        char path[256];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (!read_sys_file(path, buffer, sizeof(buffer))) { ++misses; continue; }
+
+        s32 node_count = parse_cpu_list(buffer, cpu_ids, MAX_TOPOLOGY_CPUS);
+        for (s32 j = 0; j < node_count; ++j) {
+            s32 index = topology_find(topology, cpu_ids[j]);
+            if (index < 0) { continue; }
+            topology->cpus[index].node = node;
+            ++placed;
+        }
+        if (node + 1 > topology->node_count) { topology->node_count = node + 1; }
+    }
+#endif
+
+    // Hyperthreads of the same core get increasing sibling numbers in CPU order.
+    for (s32 i = 0; i < count; ++i) {
+        Cpu_Info *info = &topology->cpus[i];
+        for (s32 j = 0; j < i; ++j) {
+            Cpu_Info *other = &topology->cpus[j];
+            if (other->package == info->package && other->core == info->core) { info->sibling++; }
+        }
+    }
+}
+
+inline void topology_deinit(Cpu_Topology *topology) {
+    if (topology->cpus) {
+        free(topology->cpus);
+        topology->cpus = NULL;
+    }
+    topology->cpu_count  = 0;
+    topology->node_count = 0;
+}
+
+inline s32 topology_node_of(Cpu_Topology *topology, s32 cpu) {
+    s32 index = topology_find(topology, cpu);
+    return (index < 0) ? 0 : topology->cpus[index].node;
+}
+
+// Fills out with the CPU ids in the order the policy hands them out. Returns how many were written,
+// 0 for PIN_NONE. Thread i goes on out[i % count].
+inline s32 topology_pin_order(Cpu_Topology *topology, Pin_Policy policy, s32 *out, s32 max) {
+    if (policy.policy == PIN_NONE) { return 0; }
+
+    if (policy.policy == PIN_EXPLICIT) {
+        s32 count = (policy.cpu_count < max) ? policy.cpu_count : max;
+        for (s32 i = 0; i < count; ++i) { out[i] = policy.cpus[i]; }
+        return count;
+    }
+
+    s32  total = topology->cpu_count;
+    s32 *order = (s32 *)calloc(total, sizeof(s32));
+    for (s32 i = 0; i < total; ++i) { order[i] = i; } // Indices into topology->cpus.
+
+    // Rank of each CPU's core inside its node so scatter can interleave nodes core by core.
+    s32 *core_rank = (s32 *)calloc(topology->cpu_count, sizeof(s32));
+    for (s32 i = 0; i < topology->cpu_count; ++i) {
+        Cpu_Info *info = &topology->cpus[i];
+        if (info->sibling) { continue; }
+        for (s32 j = 0; j < i; ++j) {
+            Cpu_Info *other = &topology->cpus[j];
+            if (other->node == info->node && !other->sibling) { core_rank[i]++; }
+        }
+    }
+    for (s32 i = 0; i < topology->cpu_count; ++i) { // Siblings share their first thread's rank.
+        Cpu_Info *info = &topology->cpus[i];
+        if (!info->sibling) { continue; }
+        for (s32 j = 0; j < i; ++j) {
+            Cpu_Info *other = &topology->cpus[j];
+            if (!other->sibling && other->package == info->package && other->core == info->core) { core_rank[i] = core_rank[j]; break; }
+        }
+    }
+
+    // Insertion sort, this runs once per pool and the lists are short.
+    for (s32 i = 1; i < total; ++i) {
+        s32 current = order[i];
+        s32 j       = i - 1;
+        while (j >= 0) {
+            Cpu_Info *a = &topology->cpus[order[j]];
+            Cpu_Info *b = &topology->cpus[current];
+            bool after;
+            if (policy.policy == PIN_COMPACT) {
+                after = (a->node != b->node)                        ? (a->node > b->node) :
+                        (core_rank[order[j]] != core_rank[current]) ? (core_rank[order[j]] > core_rank[current]) :
+                                                                      (a->sibling > b->sibling);
+            } else {
+                after = (a->sibling != b->sibling)                  ? (a->sibling > b->sibling) :
+                        (core_rank[order[j]] != core_rank[current]) ? (core_rank[order[j]] > core_rank[current]) :
+                                                                      (a->node > b->node);
+            }
+            if (!after) { break; }
+            order[j + 1] = order[j];
+            --j;
+        }
+        order[j + 1] = current;
+    }
+
+    s32 count = (total < max) ? total : max;
+    for (s32 i = 0; i < count; ++i) { out[i] = topology->cpus[order[i]].cpu; }
+
+    free(order);
+    free(core_rank);
+    return count;
+}
+
+// Pins the calling thread. Returns false if the OS refused, e.g. the CPU isn't in our cgroup.
+inline bool pin_current_thread(s32 cpu) {
+#if defined(_WIN32)
+    if (cpu < 0 || cpu >= 64) { return false; }
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE) { return false; }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Types.h"
+
+#include <atomic>
+#include <utility>
+#include <assert.h>
+#include <stddef.h> // NULL
+
+/**
+
+   A fixed capacity Chase-Lev work stealing deque.
+
+   The owning thread pushes and pops at the bottom (LIFO, so it keeps working on whatever is hot in its cache)
+   and any other thread may steal from the top (FIFO, so thieves take the oldest and usually largest piece of work).
+   Only the last element is ever contended and that is resolved with a single CAS on top.
+
+   The classic algorithm stores pointers in the buffer and reads the element before the CAS. We store the values
+   themselves so pushing doesn't need an allocation. A thief only touches a slot after it won the CAS and every
+   slot carries a 'full' flag so the owner never overwrites a slot that a slow thief is still moving out of.
+
+   The buffer doesn't grow, deque_push returns false when it is full and the caller decides where the value goes.
+
+**/
+
+#define DEQUE_CACHE_LINE_SIZE 64
+
+template <typename T>
+struct Work_Stealing_Deque {
+    struct Slot {
+        std::atomic<bool> full {false};
+        T                 value;
+    };
+
+    // Thieves hammer top and the owner hammers bottom, keep them on separate cache lines.
+    alignas(DEQUE_CACHE_LINE_SIZE) std::atomic<s64> top    {0};
+    alignas(DEQUE_CACHE_LINE_SIZE) std::atomic<s64> bottom {0};
+
+    alignas(DEQUE_CACHE_LINE_SIZE) Slot *slots = NULL;
+    s64 capacity = 0; // Always a power of 2.
+};
+
+template <typename T>
+void deque_init(Work_Stealing_Deque <T> *deque, s64 capacity) {
+    assert(capacity > 0);
+    assert((capacity & (capacity - 1)) == 0); // Power of 2 so we can mask instead of mod.
+
+    deque->slots    = new typename Work_Stealing_Deque <T>::Slot[capacity];
+    deque->capacity = capacity;
+    deque->top.store(0, std::memory_order_relaxed);
+    deque->bottom.store(0, std::memory_order_relaxed);
+}
+
+template <typename T>
+void deque_deinit(Work_Stealing_Deque <T> *deque) {
+    if (deque->slots) {
+        delete[] deque->slots;
+        deque->slots = NULL;
+    }
+    deque->capacity = 0;
+}
+
+// Approximate, only meaningful as a hint when other threads are stealing.
+template <typename T>
+inline s64 deque_size(Work_Stealing_Deque <T> *deque) {
+    s64 b = deque->bottom.load(std::memory_order_relaxed);
+    s64 t = deque->top.load(std::memory_order_relaxed);
+    return (b > t) ? (b - t) : 0;
+}
+
+// Owner only. Moves value into the deque on success, leaves it untouched if the deque is full.
+template <typename T>
+inline bool deque_push(Work_Stealing_Deque <T> *deque, T &value) {
+    s64 b = deque->bottom.load(std::memory_order_relaxed);
+    s64 t = deque->top.load(std::memory_order_acquire);
+
+    if (b - t >= deque->capacity) { return false; }
+
+    auto *slot = &deque->slots[b & (deque->capacity - 1)];
+
+    // The previous occupant of this slot has already been claimed but a thief may still be moving it out.
+    while (slot->full.load(std::memory_order_acquire)) {}
+
+    slot->value = std::move(value);
+    slot->full.store(true, std::memory_order_release);
+    deque->bottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+// Owner only.
+template <typename T>
+inline bool deque_pop(Work_Stealing_Deque <T> *deque, T *out) {
+    s64 b = deque->bottom.load(std::memory_order_relaxed) - 1;
+    deque->bottom.store(b, std::memory_order_seq_cst);
+    s64 t = deque->top.load(std::memory_order_seq_cst);
+
+    if (t > b) { // Empty.
+        deque->bottom.store(b + 1, std::memory_order_release);
+        return false;
+    }
+
+    if (t == b) { // Last element, race the thieves for it.
+        bool won = deque->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        deque->bottom.store(b + 1, std::memory_order_release);
+        if (!won) { return false; }
+    }
+
+    auto *slot = &deque->slots[b & (deque->capacity - 1)];
+    *out = std::move(slot->value);
+    slot->full.store(false, std::memory_order_release);
+    return true;
+}
+
+// Any thread. Returns false if the deque is empty or another thread beat us to the top element.
+template <typename T>
+inline bool deque_steal(Work_Stealing_Deque <T> *deque, T *out) {
+    s64 t = deque->top.load(std::memory_order_seq_cst);
+    s64 b = deque->bottom.load(std::memory_order_seq_cst);
+
+    if (t >= b) { return false; }
+
+    if (!deque->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return false;
+    }
+
+    // The slot is ours now, wait for the push that published it in case we raced ahead of its flag.
+    auto *slot = &deque->slots[t & (deque->capacity - 1)];
+    while (!slot->full.load(std::memory_order_acquire)) {}
+
+    *out = std::move(slot->value);
+    slot->full.store(false, std::memory_order_release);
+    return true;
+}
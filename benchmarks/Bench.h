@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../Types.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+
+   The few things every benchmark in this directory needs. Each benchmark is one .cpp that builds on its own, no
+   build system involved:
+
+       g++ -O2 -std=c++17 -pthread benchmarks/bench_table_find_batch.cpp -o bench_table_find_batch
+
+   Numbers only mean something from an optimized build on an otherwise idle machine. The thread scaling ones
+   stop at the hardware thread count, past that they only measure the OS scheduler.
+
+**/
+
+inline double bench_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Makes the compiler believe value is used, so the work that produced it isn't optimized away.
+template <typename T>
+inline void bench_keep(const T &value) {
+#if defined(_MSC_VER)
+    static volatile const void *sink;
+    sink = &value;
+#else
+    asm volatile("" : : "r"(&value) : "memory");
+#endif
+}
+
+// argv[index] as a number, fallback when it isn't given.
+inline s64 bench_argument(int argc, char **argv, int index, s64 fallback) {
+    return (index < argc) ? (s64)atoll(argv[index]) : fallback;
+}
+
+// xorshift, for keys and mixes that the compiler can't see through.
+inline u64 bench_random(u64 *state) {
+    u64 x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
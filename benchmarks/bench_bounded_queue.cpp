@@ -0,0 +1,124 @@
+#include "Bench.h"
+#include "../Bounded_Queue.h"
+
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+
+   Items per second through Bounded_Queue against a std::queue behind a std::mutex, the way Logger hands its
+   messages to the writer thread.
+
+       MPMC  n producers and n consumers, n from 1 to max_threads doubling.
+       MPSC  n producers and one consumer.
+       SPSC  one of each.
+
+   Producers push items / producers values each and consumers pop items / consumers each, blocking when the
+   queue is full or empty. The mutex queue's consumers yield while it is empty.
+
+       bench_bounded_queue [max_threads=32] [items=4000000] [capacity=1024]
+
+**/
+
+struct Mutex_Queue {
+    std::mutex      mutex;
+    std::queue<u64> queue;
+};
+
+static void mutex_queue_push(Mutex_Queue *queue, u64 value) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->queue.push(value);
+}
+
+static u64 mutex_queue_pop(Mutex_Queue *queue) {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            if (!queue->queue.empty()) {
+                u64 value = queue->queue.front();
+                queue->queue.pop();
+                return value;
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+// Starts the producers and consumers together and returns items per second.
+template <typename Push, typename Pop>
+static double bench_run(s64 producers, s64 consumers, s64 items, Push &&push, Pop &&pop) {
+    std::vector<std::thread> threads;
+    std::atomic<bool> go {false};
+    std::atomic<u64>  sum {0};
+
+    for (s64 p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            while (!go.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+            for (s64 i = 0; i < items / producers; ++i) { push((u64)(p * items + i)); }
+        });
+    }
+    for (s64 c = 0; c < consumers; ++c) {
+        threads.emplace_back([&] {
+            while (!go.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+            u64 local = 0;
+            for (s64 i = 0; i < items / consumers; ++i) { local += pop(); }
+            sum.fetch_add(local, std::memory_order_relaxed);
+        });
+    }
+
+    double start = bench_seconds();
+    go.store(true, std::memory_order_release);
+    for (auto &thread : threads) { thread.join(); }
+    double seconds = bench_seconds() - start;
+
+    bench_keep(sum);
+    return (double)items / seconds;
+}
+
+template <BOUNDED_QUEUE_MODE Mode>
+static double bench_bounded(s64 producers, s64 consumers, s64 items, s64 capacity) {
+    Bounded_Queue <u64, Mode> queue;
+    bounded_queue_init(&queue, capacity);
+    double result = bench_run(producers, consumers, items,
+                              [&](u64 value) { bounded_queue_push(&queue, value); },
+                              [&]() { u64 value; bounded_queue_pop(&queue, &value); return value; });
+    bounded_queue_deinit(&queue);
+    return result;
+}
+
+static double bench_mutex(s64 producers, s64 consumers, s64 items) {
+    Mutex_Queue queue;
+    return bench_run(producers, consumers, items,
+                     [&](u64 value) { mutex_queue_push(&queue, value); },
+                     [&]() { return mutex_queue_pop(&queue); });
+}
+
+int main(int argc, char **argv) {
+    s64 max_threads = bench_argument(argc, argv, 1, 32);
+    s64 items       = bench_argument(argc, argv, 2, 4000000);
+    s64 capacity    = bench_argument(argc, argv, 3, 1024);
+
+    // Every producer and consumer count below divides it.
+    s64 round = 1;
+    while (round < max_threads) { round *= 2; }
+    items = (items / round) * round;
+
+    printf("hardware threads %u, %lld items, capacity %lld\n", std::thread::hardware_concurrency(), (long long)items, (long long)capacity);
+    printf("%5s %9s  %15s %15s\n", "mode", "threads", "bounded", "mutex");
+
+    printf("%5s %4d/%-4d  %12.2fM/s %12.2fM/s\n", "SPSC", 1, 1,
+           bench_bounded<QUEUE_SPSC>(1, 1, items, capacity) / 1e6, bench_mutex(1, 1, items) / 1e6);
+
+    for (s64 n = 1; n <= max_threads; n *= 2) {
+        printf("%5s %4lld/%-4d  %12.2fM/s %12.2fM/s\n", "MPSC", (long long)n, 1,
+               bench_bounded<QUEUE_MPSC>(n, 1, items, capacity) / 1e6, bench_mutex(n, 1, items) / 1e6);
+    }
+
+    for (s64 n = 1; n <= max_threads; n *= 2) {
+        printf("%5s %4lld/%-4lld  %12.2fM/s %12.2fM/s\n", "MPMC", (long long)n, (long long)n,
+               bench_bounded<QUEUE_MPMC>(n, n, items, capacity) / 1e6, bench_mutex(n, n, items) / 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "Bench.h"
+#include "../Concurrent_Hash_Table.h"
+#include "../Lock_Free_Hash_Map.h"
+
+#include <thread>
+#include <vector>
+
+/**
+
+   Operations per second on a shared u64 -> u64 map from 1 up to max_threads threads doubling, for a read heavy
+   mix (95% finds) and a write heavy one (50% finds). Writes alternate between table_set and table_remove on
+   random keys so the table stays around half the key space.
+
+       global     one Hash_Table behind one Mutex, what shared caches did before.
+       sharded    Concurrent_Hash_Table with its default shard count.
+       lock free  Lock_Free_Hash_Map, lock free reads and one writer lock.
+
+   The threads split a fixed number of operations, so a flat line across thread counts is no scaling at all.
+
+       bench_concurrent_hash_table [max_threads=64] [operations=4000000] [keys=65536]
+
+**/
+
+struct Global_Table {
+    Hash_Table <u64, u64> table;
+    Mutex mutex;
+};
+
+static void bench_init(Global_Table *map, s64 keys) {
+    table_init(&map->table, keys);
+    mutex_create(&map->mutex);
+}
+
+static void bench_deinit(Global_Table *map) {
+    mutex_destroy(&map->mutex);
+    table_deinit(&map->table);
+}
+
+static bool bench_find(Global_Table *map, u64 key, u64 *value) {
+    Scoped_Lock lock(&map->mutex);
+    u64 *found = table_find_pointer(&map->table, key);
+    if (!found) { return false; }
+    *value = *found;
+    return true;
+}
+
+static void bench_set(Global_Table *map, u64 key, u64 value) {
+    Scoped_Lock lock(&map->mutex);
+    table_set(&map->table, key, value);
+}
+
+static void bench_remove(Global_Table *map, u64 key) {
+    Scoped_Lock lock(&map->mutex);
+    table_remove(&map->table, key);
+}
+
+static void bench_init(Concurrent_Hash_Table <u64, u64> *map, s64 keys) { table_init(map, 0, keys); }
+static void bench_deinit(Concurrent_Hash_Table <u64, u64> *map) { table_deinit(map); }
+static bool bench_find(Concurrent_Hash_Table <u64, u64> *map, u64 key, u64 *value) { return table_find(map, key, value); }
+static void bench_set(Concurrent_Hash_Table <u64, u64> *map, u64 key, u64 value) { table_set(map, key, value); }
+static void bench_remove(Concurrent_Hash_Table <u64, u64> *map, u64 key) { table_remove(map, key); }
+
+static void bench_init(Lock_Free_Hash_Map <u64, u64> *map, s64 keys) { table_init(map, keys); }
+static void bench_deinit(Lock_Free_Hash_Map <u64, u64> *map) { table_deinit(map); }
+static bool bench_find(Lock_Free_Hash_Map <u64, u64> *map, u64 key, u64 *value) { return table_find(map, key, value); }
+static void bench_set(Lock_Free_Hash_Map <u64, u64> *map, u64 key, u64 value) { table_set(map, key, value); }
+static void bench_remove(Lock_Free_Hash_Map <u64, u64> *map, u64 key) { table_remove(map, key); }
+
+template <typename Map>
+static double bench_mix(s64 threads, s64 operations, s64 keys, s64 read_percent) {
+    Map map;
+    bench_init(&map, keys);
+    for (s64 key = 0; key < keys; key += 2) { bench_set(&map, (u64)key, (u64)key); }
+
+    std::vector<std::thread> workers;
+    std::atomic<bool> go {false};
+
+    for (s64 t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            u64 state = 88172645463325252ull + (u64)t * 0x9e3779b97f4a7c15ull;
+            u64 sum   = 0;
+            bool set  = true;
+            while (!go.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+
+            for (s64 i = 0; i < operations / threads; ++i) {
+                u64 r   = bench_random(&state);
+                u64 key = (r >> 8) % (u64)keys;
+                if ((s64)(r & 127) * 100 < read_percent * 128) {
+                    u64 value;
+                    if (bench_find(&map, key, &value)) { sum += value; }
+                } else {
+                    if (set) { bench_set(&map, key, key); }
+                    else     { bench_remove(&map, key); }
+                    set = !set;
+                }
+            }
+            bench_keep(sum);
+        });
+    }
+
+    double start = bench_seconds();
+    go.store(true, std::memory_order_release);
+    for (auto &worker : workers) { worker.join(); }
+    double seconds = bench_seconds() - start;
+
+    bench_deinit(&map);
+    return (double)((operations / threads) * threads) / seconds;
+}
+
+int main(int argc, char **argv) {
+    s64 max_threads = bench_argument(argc, argv, 1, 64);
+    s64 operations  = bench_argument(argc, argv, 2, 4000000);
+    s64 keys        = bench_argument(argc, argv, 3, 65536);
+
+    printf("hardware threads %u, %lld operations over %lld keys\n", std::thread::hardware_concurrency(), (long long)operations, (long long)keys);
+
+    const s64 mixes[] = {95, 50};
+    for (s64 read_percent : mixes) {
+        printf("\n%lld%% finds\n", (long long)read_percent);
+        printf("%8s  %15s %15s %15s\n", "threads", "global", "sharded", "lock free");
+
+        for (s64 threads = 1; threads <= max_threads; threads *= 2) {
+            double global    = bench_mix<Global_Table>(threads, operations, keys, read_percent);
+            double sharded   = bench_mix<Concurrent_Hash_Table <u64, u64>>(threads, operations, keys, read_percent);
+            double lock_free = bench_mix<Lock_Free_Hash_Map <u64, u64>>(threads, operations, keys, read_percent);
+            printf("%8lld  %12.2fM/s %12.2fM/s %12.2fM/s\n", (long long)threads, global / 1e6, sharded / 1e6, lock_free / 1e6);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "Bench.h"
+#include "../Hash.h"
+
+/**
+
+   Throughput of hash_64 against murmur_32 for inputs from 4 bytes to 64KB, and of the streaming API fed the
+   same input in 256 byte pieces. Short inputs are what hash table keys look like, so they are also shown as
+   hashes per second.
+
+   Every hash starts at an offset taken from the previous result, so the calls can't be hoisted out of the loop
+   and the input isn't always aligned.
+
+       bench_hash [min_bytes=4] [max_bytes=65536] [bytes_per_size=268435456]
+
+**/
+
+const u64 BENCH_HASH_PIECE = 256;
+
+static u8 *bench_data;
+
+static u64 bench_murmur_32(u64 size, s64 iterations) {
+    u64 h = 0;
+    for (s64 i = 0; i < iterations; ++i) {
+        h += murmur_32(bench_data + (h & 63), (s32)size);
+    }
+    return h;
+}
+
+static u64 bench_hash_64(u64 size, s64 iterations) {
+    u64 h = 0;
+    for (s64 i = 0; i < iterations; ++i) {
+        h += hash_64(bench_data + (h & 63), size);
+    }
+    return h;
+}
+
+static u64 bench_hash_64_stream(u64 size, s64 iterations) {
+    u64 h = 0;
+    Hash_64_State state;
+    for (s64 i = 0; i < iterations; ++i) {
+        const u8 *p = bench_data + (h & 63);
+        hash_64_init(&state);
+        for (u64 done = 0; done < size; done += BENCH_HASH_PIECE) {
+            u64 piece = size - done < BENCH_HASH_PIECE ? size - done : BENCH_HASH_PIECE;
+            hash_64_update(&state, p + done, piece);
+        }
+        h += hash_64_final(&state);
+    }
+    return h;
+}
+
+static double bench_rate(u64 (*run)(u64, s64), u64 size, s64 iterations) {
+    double start = bench_seconds();
+    u64 h = run(size, iterations);
+    double seconds = bench_seconds() - start;
+    bench_keep(h);
+    return (double)iterations / seconds;
+}
+
+int main(int argc, char **argv) {
+    s64 min_bytes      = bench_argument(argc, argv, 1, 4);
+    s64 max_bytes      = bench_argument(argc, argv, 2, 65536);
+    s64 bytes_per_size = bench_argument(argc, argv, 3, (s64)1 << 28);
+
+    bench_data = (u8 *)malloc((size_t)max_bytes + 64);
+    u64 state = 88172645463325252ull;
+    for (s64 i = 0; i < max_bytes + 64; ++i) { bench_data[i] = (u8)bench_random(&state); }
+
+#if HASH_AVX2
+    const char *path = hash_cpu_has_avx2() ? "avx2" : (HASH_SSE2 ? "sse2" : "scalar");
+#elif HASH_SSE2
+    const char *path = "sse2";
+#else
+    const char *path = "scalar";
+#endif
+    printf("hash_64 long input path: %s\n", path);
+    printf("%8s  %21s  %21s  %21s\n", "bytes", "murmur_32", "hash_64", "hash_64 streamed");
+
+    for (s64 size = min_bytes; size <= max_bytes; size *= 2) {
+        s64 iterations = bytes_per_size / size;
+        if (iterations < 1000000 && size <= 64) { iterations = 1000000; }
+
+        double rates[3] = {
+            bench_rate(bench_murmur_32,      (u64)size, iterations),
+            bench_rate(bench_hash_64,        (u64)size, iterations),
+            bench_rate(bench_hash_64_stream, (u64)size, iterations),
+        };
+
+        printf("%8lld", (long long)size);
+        for (double rate : rates) {
+            printf("  %7.2fGB/s %6.1fM/s", rate * (double)size / 1e9, rate / 1e6);
+        }
+        printf("\n");
+    }
+
+    free(bench_data);
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "Bench.h"
+#include "../SoA_Array.h"
+
+/**
+
+   Field scans over SoA_Array against the same entities kept as an Array of structs. The struct is a typical
+   64 byte entity; the loops touch one or two of its fields, the case SoA_Array is for.
+
+       sum x       reads one field.
+       x += vx     reads two fields and writes one.
+
+   Elements per second, best of passes. Small counts fit in cache and mostly show the loop code; once the structs
+   stop fitting the Array loops pull a whole cache line for every four or eight bytes they use.
+
+       bench_soa_array [max_count=16777216] [passes=5]
+
+**/
+
+struct Entity {
+    f32 x, y, z;
+    f32 vx, vy, vz;
+    f32 mass;
+    s32 id;
+    u64 flags;
+    u64 owner;
+    u8  padding[16];
+};
+
+struct Entity_Ref {
+    f32 &x; f32 &y; f32 &z;
+    f32 &vx; f32 &vy; f32 &vz;
+    f32 &mass;
+    s32 &id;
+    u64 &flags;
+    u64 &owner;
+};
+
+typedef SoA_Array <Entity_Ref, f32, f32, f32, f32, f32, f32, f32, s32, u64, u64> Entity_SoA;
+
+static double bench_best(s64 passes, s64 count, double (*run)(void *), void *data) {
+    double best = 0;
+    for (s64 pass = 0; pass < passes; ++pass) {
+        double start = bench_seconds();
+        double result = run(data);
+        double rate = (double)count / (bench_seconds() - start);
+        bench_keep(result);
+        if (rate > best) { best = rate; }
+    }
+    return best;
+}
+
+static double aos_sum_x(void *data) {
+    Array <Entity> *array = (Array <Entity> *)data;
+    f32 sum = 0;
+    for (s32 i = 0; i < array->size; ++i) { sum += (*array)[i].x; }
+    return sum;
+}
+
+static double aos_integrate(void *data) {
+    Array <Entity> *array = (Array <Entity> *)data;
+    for (s32 i = 0; i < array->size; ++i) { (*array)[i].x += (*array)[i].vx * 0.5f; }
+    bench_keep(array->data[0]);
+    return 0;
+}
+
+static double soa_sum_x(void *data) {
+    SoA_Span <f32> xs = soa_span<0>((Entity_SoA *)data);
+    f32 sum = 0;
+    for (s32 i = 0; i < xs.size; ++i) { sum += xs.data[i]; }
+    return sum;
+}
+
+static double soa_integrate(void *data) {
+    SoA_Span <f32> xs  = soa_span<0>((Entity_SoA *)data);
+    SoA_Span <f32> vxs = soa_span<3>((Entity_SoA *)data);
+    for (s32 i = 0; i < xs.size; ++i) { xs.data[i] += vxs.data[i] * 0.5f; }
+    bench_keep(xs.data[0]);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    s64 max_count = bench_argument(argc, argv, 1, (s64)1 << 24);
+    s64 passes    = bench_argument(argc, argv, 2, 5);
+
+    printf("sizeof(Entity) %d, best of %lld passes\n", (s32)sizeof(Entity), (long long)passes);
+    printf("%10s  %15s %15s  %15s %15s\n", "count", "sum x aos", "sum x soa", "x += vx aos", "x += vx soa");
+
+    for (s64 count = 1024; count <= max_count; count *= 4) {
+        Array <Entity> aos;
+        array_init(&aos);
+        Entity_SoA soa;
+        array_init(&soa);
+
+        u64 state = 88172645463325252ull;
+        for (s64 i = 0; i < count; ++i) {
+            Entity e = {};
+            e.x  = (f32)(bench_random(&state) & 1023);
+            e.vx = (f32)(bench_random(&state) & 1023);
+            e.id = (s32)i;
+            array_add(&aos, e);
+            array_add(&soa, e.x, e.y, e.z, e.vx, e.vy, e.vz, e.mass, e.id, e.flags, e.owner);
+        }
+
+        double aos_sum = bench_best(passes, count, aos_sum_x, &aos);
+        double soa_sum = bench_best(passes, count, soa_sum_x, &soa);
+        double aos_int = bench_best(passes, count, aos_integrate, &aos);
+        double soa_int = bench_best(passes, count, soa_integrate, &soa);
+        printf("%10lld  %12.1fM/s %12.1fM/s  %12.1fM/s %12.1fM/s\n", (long long)count,
+               aos_sum / 1e6, soa_sum / 1e6, aos_int / 1e6, soa_int / 1e6);
+
+        array_deinit(&soa);
+        array_deinit(&aos);
+    }
+    return 0;
+}
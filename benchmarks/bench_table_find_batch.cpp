@@ -0,0 +1,79 @@
+#include "Bench.h"
+#include "../Hash_Table.h"
+
+/**
+
+   Lookups per second into a u64 -> u64 Hash_Table of 2^min_log to 2^max_log entries, table_find_pointer in a
+   loop against table_find_batch over the same random existing keys. While the table fits in cache the two are
+   close; past that every single lookup waits out its own cache miss and the batch overlaps them.
+
+   The keys are looked up in chunks of batch keys, the way a caller with a list of ids would.
+
+       bench_table_find_batch [min_log=10] [max_log=24] [lookups=4000000] [batch=1024]
+
+**/
+
+static double bench_single(Hash_Table <u64, u64> *table, const u64 *keys, s64 lookups) {
+    double start = bench_seconds();
+    u64 sum = 0;
+    for (s64 i = 0; i < lookups; ++i) {
+        u64 *value = table_find_pointer(table, keys[i]);
+        if (value) { sum += *value; }
+    }
+    double seconds = bench_seconds() - start;
+    bench_keep(sum);
+    return (double)lookups / seconds;
+}
+
+static double bench_batch(Hash_Table <u64, u64> *table, const u64 *keys, s64 lookups, s32 batch, u64 **values) {
+    double start = bench_seconds();
+    u64 sum = 0;
+    for (s64 i = 0; i < lookups; i += batch) {
+        s32 count = (lookups - i < batch) ? (s32)(lookups - i) : batch;
+        table_find_batch(table, keys + i, count, values);
+        for (s32 j = 0; j < count; ++j) {
+            if (values[j]) { sum += *values[j]; }
+        }
+    }
+    double seconds = bench_seconds() - start;
+    bench_keep(sum);
+    return (double)lookups / seconds;
+}
+
+int main(int argc, char **argv) {
+    s64 min_log = bench_argument(argc, argv, 1, 10);
+    s64 max_log = bench_argument(argc, argv, 2, 24);
+    s64 lookups = bench_argument(argc, argv, 3, 4000000);
+    s32 batch   = (s32)bench_argument(argc, argv, 4, 1024);
+
+    u64  *keys   = (u64 *)malloc(sizeof(u64) * (size_t)lookups);
+    u64 **values = (u64 **)malloc(sizeof(u64 *) * (size_t)batch);
+
+    printf("%lld lookups in batches of %d\n", (long long)lookups, batch);
+    printf("%10s  %15s %15s %8s\n", "entries", "single", "batch", "speedup");
+
+    for (s64 log = min_log; log <= max_log; ++log) {
+        s64 entries = (s64)1 << log;
+
+        Hash_Table <u64, u64> table;
+        table_init(&table, entries);
+        u64 *inserted = (u64 *)malloc(sizeof(u64) * (size_t)entries);
+        u64 state = 88172645463325252ull;
+        for (s64 i = 0; i < entries; ++i) {
+            inserted[i] = bench_random(&state);
+            table_set(&table, inserted[i], (u64)i);
+        }
+        for (s64 i = 0; i < lookups; ++i) { keys[i] = inserted[bench_random(&state) % (u64)entries]; }
+        free(inserted);
+
+        double single  = bench_single(&table, keys, lookups);
+        double batched = bench_batch(&table, keys, lookups, batch, values);
+        printf("%10lld  %12.2fM/s %12.2fM/s %7.2fx\n", (long long)entries, single / 1e6, batched / 1e6, batched / single);
+
+        table_deinit(&table);
+    }
+
+    free(values);
+    free(keys);
+    return 0;
+}
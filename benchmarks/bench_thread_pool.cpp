@@ -0,0 +1,86 @@
+#include "Bench.h"
+#include "../Thread_Pool.h"
+
+#include <thread>
+
+/**
+
+   Tasks per second through Thread_Pool, GLOBAL_QUEUE against WORK_STEALING, for 1 worker up to max_threads
+   doubling in between.
+
+       flat    the main thread submits every task and waits for the group.
+       nested  every task submits two more until depth runs out, so the workers feed themselves. This is the load
+               work stealing is for: with one queue every spawn goes through the same lock.
+
+   Every task spins through task_work rounds of xorshift, so the pool overhead is what differs.
+
+       bench_thread_pool [max_threads=64] [tasks=1000000] [task_work=50]
+
+**/
+
+static s64 task_work = 50;
+
+static void bench_task_body() {
+    u64 state = 88172645463325252ull;
+    for (s64 i = 0; i < task_work; ++i) { bench_random(&state); }
+    bench_keep(state);
+}
+
+static double bench_flat(Thread_Pool *pool, s64 tasks) {
+    double start = bench_seconds();
+
+    Task_Group group;
+    for (s64 i = 0; i < tasks; ++i) {
+        process(pool, [] { bench_task_body(); }, &group);
+    }
+    wait(pool, &group);
+    deinit(&group);
+
+    return (double)tasks / (bench_seconds() - start);
+}
+
+static void bench_spawn(Thread_Pool *pool, Task_Group *group, s32 depth) {
+    bench_task_body();
+    if (depth == 0) { return; }
+    process(pool, [pool, group, depth] { bench_spawn(pool, group, depth - 1); }, group);
+    process(pool, [pool, group, depth] { bench_spawn(pool, group, depth - 1); }, group);
+}
+
+static double bench_nested(Thread_Pool *pool, s64 tasks) {
+    // A full binary tree of about tasks nodes.
+    s32 depth = 0;
+    while (((s64)2 << (depth + 1)) - 1 <= tasks) { depth++; }
+    s64 count = ((s64)2 << depth) - 1;
+
+    double start = bench_seconds();
+
+    Task_Group group;
+    process(pool, [pool, &group, depth] { bench_spawn(pool, &group, depth); }, &group);
+    wait(pool, &group);
+    deinit(&group);
+
+    return (double)count / (bench_seconds() - start);
+}
+
+int main(int argc, char **argv) {
+    s64 max_threads = bench_argument(argc, argv, 1, 64);
+    s64 tasks       = bench_argument(argc, argv, 2, 1000000);
+    task_work       = bench_argument(argc, argv, 3, 50);
+
+    printf("hardware threads %u, %lld tasks of %lld rounds\n", std::thread::hardware_concurrency(), (long long)tasks, (long long)task_work);
+    printf("%8s  %15s %15s  %15s %15s\n", "threads", "flat global", "flat stealing", "nested global", "nested stealing");
+
+    for (s64 threads = 1; threads <= max_threads; threads *= 2) {
+        double results[2][2];
+        for (s32 mode = 0; mode < 2; ++mode) {
+            Thread_Pool pool;
+            init(&pool, (u64)threads, mode == 0 ? GLOBAL_QUEUE : WORK_STEALING);
+            results[0][mode] = bench_flat(&pool, tasks);
+            results[1][mode] = bench_nested(&pool, tasks);
+            deinit(&pool);
+        }
+        printf("%8lld  %12.2fM/s %12.2fM/s  %12.2fM/s %12.2fM/s\n", (long long)threads,
+               results[0][0] / 1e6, results[0][1] / 1e6, results[1][0] / 1e6, results[1][1] / 1e6);
+    }
+    return 0;
+}